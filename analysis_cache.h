@@ -0,0 +1,184 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// ===========================
+//  Fast 64-bit content hash
+// ===========================
+// wyhash-style: 8 bytes per step folded with a 64x64->128 multiply.
+// Not cryptographic; two seeds give the 128-bit cache keys below.
+inline uint64_t hashMix(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+#else
+    uint64_t ha = a >> 32, la = a & 0xffffffffu, hb = b >> 32, lb = b & 0xffffffffu;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t lo = t + (rm1 << 32);
+    uint64_t hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+    return lo ^ hi;
+#endif
+}
+
+inline uint64_t hashBytes(const void* data, size_t len, uint64_t seed) {
+    const uint64_t p0 = 0xa0761d6478bd642full, p1 = 0xe7037ed1a0b428dbull, p2 = 0x8ebc6af09c88c6e3ull;
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed ^ p0 ^ (static_cast<uint64_t>(len) * p2);
+
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint64_t a, b;
+        std::memcpy(&a, p + i, 8);
+        std::memcpy(&b, p + i + 8, 8);
+        h = hashMix(a ^ p1 ^ h, b ^ p2 ^ h);
+    }
+
+    // Tail: up to 15 bytes, zero padded
+    uint64_t a = 0, b = 0;
+    size_t rest = len - i;
+    if (rest > 8) {
+        std::memcpy(&a, p + i, 8);
+        std::memcpy(&b, p + i + 8, rest - 8);
+    } else {
+        std::memcpy(&a, p + i, rest);
+    }
+    return hashMix(p1 ^ len, hashMix(a ^ p1 ^ h, b ^ p0));
+}
+
+// ===========================
+//  Cache key for one chunk
+// ===========================
+struct ChunkKey {
+    uint64_t hi = 0;
+    uint64_t lo = 0;
+
+    bool operator==(const ChunkKey& o) const { return hi == o.hi && lo == o.lo; }
+};
+
+struct ChunkKeyHash {
+    size_t operator()(const ChunkKey& k) const { return static_cast<size_t>(k.lo); }
+};
+
+// `context` must cover everything besides the text that changes the answer
+// (model, prompt version, max_tokens), so a prompt change never hits old entries.
+inline ChunkKey makeChunkKey(const std::string& context, const char* text, size_t len) {
+    uint64_t seed = hashBytes(context.data(), context.size(), 0x5eed);
+    return ChunkKey{hashBytes(text, len, seed), hashBytes(text, len, ~seed)};
+}
+
+// ===========================
+//  Sharded LRU of chunk highlights
+// ===========================
+// Bounded by an approximate byte budget split evenly over the shards; each
+// shard evicts its least recently used entries once it goes over its share.
+class ChunkCache {
+public:
+    struct Stats {
+        uint64_t hits, misses, inserts, evictions, entries, bytes, capacityBytes;
+    };
+
+    explicit ChunkCache(size_t capacityBytes, size_t shards = 16):
+      shards_(shards ? shards : 1), capacity_(capacityBytes) {
+        shardCapacity_ = capacity_ / shards_.size();
+    }
+
+    bool enabled() const { return capacity_ > 0; }
+
+    bool get(const ChunkKey& key, std::vector<std::string>& out) {
+        if (!enabled()) return false;
+        Shard& s = shardFor(key);
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            auto it = s.index.find(key);
+            if (it != s.index.end()) {
+                s.lru.splice(s.lru.begin(), s.lru, it->second);
+                out = it->second->highlights;
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    void put(const ChunkKey& key, const std::vector<std::string>& highlights) {
+        if (!enabled()) return;
+        size_t cost = entryCost(highlights);
+        if (cost > shardCapacity_) return;
+
+        Shard& s = shardFor(key);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto it = s.index.find(key);
+        if (it != s.index.end()) {
+            s.bytes -= it->second->cost;
+            bytes_.fetch_sub(it->second->cost, std::memory_order_relaxed);
+            it->second->highlights = highlights;
+            it->second->cost = cost;
+            s.lru.splice(s.lru.begin(), s.lru, it->second);
+        } else {
+            s.lru.push_front(Entry{key, highlights, cost});
+            s.index.emplace(key, s.lru.begin());
+            entries_.fetch_add(1, std::memory_order_relaxed);
+        }
+        s.bytes += cost;
+        bytes_.fetch_add(cost, std::memory_order_relaxed);
+        inserts_.fetch_add(1, std::memory_order_relaxed);
+
+        while (s.bytes > shardCapacity_ && !s.lru.empty()) {
+            Entry& victim = s.lru.back();
+            s.bytes -= victim.cost;
+            bytes_.fetch_sub(victim.cost, std::memory_order_relaxed);
+            s.index.erase(victim.key);
+            s.lru.pop_back();
+            entries_.fetch_sub(1, std::memory_order_relaxed);
+            evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    Stats stats() const {
+        return Stats{hits_.load(std::memory_order_relaxed),
+                     misses_.load(std::memory_order_relaxed),
+                     inserts_.load(std::memory_order_relaxed),
+                     evictions_.load(std::memory_order_relaxed),
+                     entries_.load(std::memory_order_relaxed),
+                     bytes_.load(std::memory_order_relaxed),
+                     capacity_};
+    }
+
+private:
+    struct Entry {
+        ChunkKey key;
+        std::vector<std::string> highlights;
+        size_t cost;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_map<ChunkKey, std::list<Entry>::iterator, ChunkKeyHash> index;
+        size_t bytes = 0;
+    };
+
+    // Rough heap footprint: list node + index node + the strings themselves
+    static size_t entryCost(const std::vector<std::string>& highlights) {
+        size_t cost = sizeof(Entry) + 64;
+        for (auto& h : highlights) cost += sizeof(std::string) + h.size();
+        return cost;
+    }
+
+    Shard& shardFor(const ChunkKey& key) { return shards_[key.hi % shards_.size()]; }
+
+    std::vector<Shard> shards_;
+    size_t capacity_;
+    size_t shardCapacity_;
+
+    std::atomic<uint64_t> hits_{0}, misses_{0}, inserts_{0}, evictions_{0}, entries_{0}, bytes_{0};
+};
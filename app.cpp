@@ -1,189 +1,924 @@
 #define CROW_MAIN
 #define CROW_USE_BOOST
+#define CROW_ENABLE_SSL
 #include "crow_all.h"
+#include "analysis_cache.h"
+#include "async_log.h"
+#include "chunking.h"
+#include "circuit_breaker.h"
+#include "hedged_call.h"
+#include "highlight_dedup.h"
+#include "job_store.h"
+#include "mapped_store.h"
+#include "metrics.h"
+#include "offline_analyzer.h"
+#include "openai_protocol.h"
+#include "phrase_matcher.h"
+#include "rate_limiter.h"
+#include "request_arena.h"
+#include "request_trace.h"
+#include "single_flight.h"
+#include "upstream_client.h"
+#include "worker_pool.h"
 
 #include <string>
+#include <string_view>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
 #include <vector>
-#include <fstream>
 #include <algorithm>
 #include <iterator>
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
-#include <sstream>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <cctype>
 
 using namespace std;
 
 // ===========================
-//  Split text into chunks
+//  Logging
 // ===========================
-vector<string> chunkText(const string& text, size_t maxChars = 3000) {
-    vector<string> chunks;
-    size_t pos = 0;
-    
-    while (pos < text.length()) {
-        size_t chunkSize = min(maxChars, text.length() - pos);
-        
-        // Try to break at sentence boundary
-        if (pos + chunkSize < text.length()) {
-            size_t lastPeriod = text.rfind('.', pos + chunkSize);
-            if (lastPeriod != string::npos && lastPeriod > pos) {
-                chunkSize = lastPeriod - pos + 1;
-            }
-        }
-        
-        chunks.push_back(text.substr(pos, chunkSize));
-        pos += chunkSize;
+// All server output goes through the asynchronous sink (Crow's own lines
+// too, see main), so request threads never block on stdout. TOS_LOG_BUFFER
+// is the number of lines it holds before dropping.
+AsyncLog& logSink() {
+    static AsyncLog sink(envSize("TOS_LOG_BUFFER", 4096), stdout);
+    return sink;
+}
+
+void logInfo(string_view message, initializer_list<LogField> fields = {}) {
+    logSink().event(crow::LogLevel::Info, message, fields);
+}
+
+void logWarning(string_view message, initializer_list<LogField> fields = {}) {
+    logSink().event(crow::LogLevel::Warning, message, fields);
+}
+
+// ===========================
+//  Metrics
+// ===========================
+// Everything GET /metrics reports beyond the existing stats. Durations are
+// recorded in nanoseconds; recording is lock-free (see metrics.h).
+enum class Stage { Chunking, Payload, Upstream, Parse, Merge, Serialize, Count };
+const char* const kStageNames[] = {"chunking", "payload", "upstream", "parse", "merge", "serialize"};
+
+enum class Route { Analyze, AnalyzeStream, Batch, Job, WebSocket, Count };
+const char* const kRouteNames[] = {"analyze", "analyze_stream", "batch", "job", "websocket"};
+
+struct Metrics {
+    Histogram stages[size_t(Stage::Count)];
+    Histogram requests[size_t(Route::Count)];
+    Histogram documentHighlights; // highlights per finished document
+    Counter highlights;
+    Gauge inFlight;
+};
+
+Metrics& metrics() {
+    static Metrics m;
+    return m;
+}
+
+Histogram& stageTimer(Stage stage) {
+    return metrics().stages[size_t(stage)];
+}
+
+// Times a stage into its histogram and, on traced requests, as a span
+class StageScope {
+public:
+    explicit StageScope(Stage stage) : timer_(stageTimer(stage)), span_(kStageNames[size_t(stage)], "stage") {}
+
+private:
+    ScopedTimer timer_;
+    TraceSpan span_;
+};
+
+// One analysis from when the request arrived (so queueing counts) until this
+// goes out of scope; it counts as in flight while it runs.
+class RequestScope {
+public:
+    RequestScope(Route route, chrono::steady_clock::time_point arrived)
+        : timer_(metrics().requests[size_t(route)], arrived) {
+        metrics().inFlight.add(1);
     }
-    
-    return chunks;
+    ~RequestScope() { metrics().inFlight.add(-1); }
+
+private:
+    ScopedTimer timer_;
+};
+
+// ===========================
+//  Request tracing
+// ===========================
+// A request is traced when it carries "X-Trace: 1", or by sampling
+// TOS_TRACE_SAMPLE_PCT percent of the rest ("X-Trace: 0" opts out). The
+// reply's X-Trace-Id header names the trace; the last TOS_TRACE_KEEP traces
+// are served from /debug/traces/{id}.
+TraceStore& traceStore() {
+    static TraceStore store(envSize("TOS_TRACE_KEEP", 100));
+    return store;
+}
+
+shared_ptr<Trace> maybeTrace(const crow::request& req) {
+    static const size_t samplePct = envSize("TOS_TRACE_SAMPLE_PCT", 0);
+    string flag = req.get_header_value("X-Trace");
+    bool traced = flag == "1" || flag == "true";
+    if (flag.empty() && samplePct > 0) {
+        thread_local mt19937 rng{random_device{}()};
+        traced = uniform_int_distribution<size_t>(0, 99)(rng) < samplePct;
+    }
+    if (!traced) return nullptr;
+    return traceStore().create(crow::method_name(req.method) + " " + req.url);
+}
+
+void addTraceHeaders(crow::response& res, const shared_ptr<Trace>& trace) {
+    if (!trace) return;
+    res.add_header("X-Trace-Id", trace->id());
+    res.add_header("Access-Control-Expose-Headers", "X-Trace-Id");
+}
+
+// ===========================
+//  Pick the chunker
+// ===========================
+// TOS_CHUNKING selects how a document is split:
+//   cdc    (default) content-defined, sizes from TOS_CDC_MIN / TOS_CDC_AVG / TOS_CDC_MAX
+//   tokens packs sentences up to TOS_CHUNK_TOKENS estimated tokens per chunk
+//   fixed  the old 3000-char chunks
+vector<string_view> splitDocument(string_view text) {
+    StageScope stage(Stage::Chunking);
+    static const string mode = [] {
+        const char* m = getenv("TOS_CHUNKING");
+        return string(m && *m ? m : "cdc");
+    }();
+    if (mode == "fixed") {
+        return chunkViews(text, 3000);
+    }
+    if (mode == "tokens") {
+        static const size_t budget = envSize("TOS_CHUNK_TOKENS", 1500);
+        return chunkViewsByTokens(text, budget);
+    }
+    static const size_t minChars = max<size_t>(envSize("TOS_CDC_MIN", 1000), 1);
+    static const size_t avgChars = max<size_t>(envSize("TOS_CDC_AVG", 2500), 1);
+    static const size_t maxChars = max<size_t>(envSize("TOS_CDC_MAX", 4000), 1);
+    return chunkViewsCDC(text, minChars, avgChars, maxChars);
+}
+
+// ===========================
+//  Shared upstream client
+// ===========================
+// OPENAI_BASE_URL points the analyzer at another chat-completions server,
+// e.g. http://127.0.0.1:9000/v1 for a local stand-in.
+UpstreamClient* upstream() {
+    static unique_ptr<UpstreamClient> client = [] {
+        const char* base = getenv("OPENAI_BASE_URL");
+        string url = base && *base ? base : "https://api.openai.com/v1";
+        UpstreamUrl parsed;
+        if (!UpstreamUrl::parse(url, parsed)) {
+            logWarning("Invalid OPENAI_BASE_URL", {{"url", url}});
+            return unique_ptr<UpstreamClient>();
+        }
+        return make_unique<UpstreamClient>(parsed,
+                                           envSize("TOS_UPSTREAM_POOL", 16),
+                                           chrono::milliseconds(envSize("TOS_UPSTREAM_TIMEOUT_MS", 60000)));
+    }();
+    return client.get();
+}
+
+// ===========================
+//  Upstream rate limit
+// ===========================
+// TOS_UPSTREAM_RPM / TOS_UPSTREAM_TPM seed the request and token budgets per
+// minute; 0 (the default) waits for the upstream's x-ratelimit-* headers.
+RateLimiter& rateLimiter() {
+    static RateLimiter limiter(envSize("TOS_UPSTREAM_RPM", 0), envSize("TOS_UPSTREAM_TPM", 0));
+    return limiter;
+}
+
+// What one chunk call counts against the token budget: the prompt plus the
+// max_tokens the upstream reserves for the answer.
+double chunkCallTokens(string_view tosChunk) {
+    static const size_t promptTokens = estimateTokens(kSystemPrompt) + 32;
+    return double(estimateTokens(tosChunk) + promptTokens + kMaxTokens);
+}
+
+// ===========================
+//  Hedged requests
+// ===========================
+// TOS_HEDGE_PERCENTILE (e.g. 95) sends a duplicate of any chunk call still
+// running past that percentile of recent latency; 0 (the default) never does.
+// TOS_HEDGE_MAX_PERCENT caps duplicates per 100 calls (default 5).
+HedgedCaller& hedger() {
+    static HedgedCaller caller(envSize("TOS_HEDGE_PERCENTILE", 0), envSize("TOS_HEDGE_MAX_PERCENT", 5),
+                               2 * envSize("TOS_MAX_INFLIGHT", 8));
+    return caller;
+}
+
+// ===========================
+//  Upstream circuit breaker
+// ===========================
+// Opens when TOS_BREAKER_FAILURE_PCT of the last 50 chunk calls (at least 10)
+// failed outright or took TOS_BREAKER_SLOW_MS or longer; while open, chunk
+// calls fail at once for TOS_BREAKER_OPEN_MS and chunks are answered from
+// the caches or the offline engine.
+CircuitBreaker& upstreamBreaker() {
+    static CircuitBreaker breaker([] {
+        CircuitBreaker::Options o;
+        o.failureRatio = envSize("TOS_BREAKER_FAILURE_PCT", 50) / 100.0;
+        o.slowCall = chrono::milliseconds(envSize("TOS_BREAKER_SLOW_MS", 30000));
+        o.openFor = chrono::milliseconds(envSize("TOS_BREAKER_OPEN_MS", 10000));
+        return o;
+    }());
+    return breaker;
 }
 
 // ===========================
 //  Call OpenAI with a chunk
 // ===========================
-string callOpenAIChunk(const string& tosChunk, int chunkNum, int totalChunks) {
+// 429s, 5xx replies and transport failures are retried up to
+// TOS_UPSTREAM_RETRIES times with jittered exponential backoff starting at
+// TOS_RETRY_BASE_MS; a 429 also holds every other chunk call via the limiter.
+// Each attempt may be hedged (see hedger()) and goes through the circuit
+// breaker; a refused attempt ends the call like a failed one.
+string callOpenAIChunk(string_view tosChunk, int chunkNum, int totalChunks) {
+    static const int maxRetries = static_cast<int>(envSize("TOS_UPSTREAM_RETRIES", 3));
+    static const chrono::milliseconds retryBase(envSize("TOS_RETRY_BASE_MS", 250));
+    static const chrono::milliseconds retryCap(8000);
+    static const chrono::milliseconds maxLimiterWait(envSize("TOS_UPSTREAM_TIMEOUT_MS", 60000));
+
     const char* key = getenv("OPENAI_API_KEY");
     if (!key) {
         return R"({"summary":"Error: OPENAI_API_KEY not set","highlights":[]})";
     }
 
-    // Build JSON payload
-    crow::json::wvalue payload;
-    payload["model"] = "gpt-4o-mini";
-    payload["max_tokens"] = 800;
-    
-    crow::json::wvalue system_msg;
-    system_msg["role"] = "system";
-    system_msg["content"] = "You are analyzing Terms of Service. Extract important clauses about privacy, data collection, liability, fees, and user rights. "
-        "Respond ONLY with valid JSON: {\"highlights\": [\"clause1\", \"clause2\", ...]}";
-    
-    crow::json::wvalue user_msg;
-    user_msg["role"] = "user";
-    
-    stringstream content;
-    content << "This is part " << chunkNum << " of " << totalChunks << " of a Terms of Service. "
-            << "Extract important clauses:\n\n" << tosChunk;
-    user_msg["content"] = content.str();
-    
-    crow::json::wvalue msgs;
-    msgs[0] = std::move(system_msg);
-    msgs[1] = std::move(user_msg);
-    payload["messages"] = std::move(msgs);
+    UpstreamClient* client = upstream();
+    if (!client) {
+        return R"({"highlights":[]})";
+    }
 
-    string jsonPayload = payload.dump();
-    
-    // Write to file
-    string tmpPath = "openai_payload_" + to_string(chunkNum) + ".json";
+    // Serialize the payload into a buffer shared with any hedged duplicate,
+    // which can outlive this call once cancelled
+    auto jsonPayload = make_shared<string>();
     {
-        ofstream out(tmpPath, ios::out | ios::binary);
-        if (!out.good()) {
+        StageScope stage(Stage::Payload);
+        buildChatPayload(*jsonPayload, tosChunk, chunkNum, totalChunks);
+    }
+    auto headers = make_shared<vector<pair<string, string>>>(vector<pair<string, string>>{
+        {"Content-Type", "application/json"}, {"Authorization", "Bearer " + string(key)}});
+    auto send = [client, jsonPayload, headers](const atomic<bool>* cancel) {
+        return client->post("/chat/completions", *headers, *jsonPayload, cancel);
+    };
+
+    double cost = chunkCallTokens(tosChunk);
+    for (int attempt = 0;; attempt++) {
+        {
+            TraceSpan wait("rate limit wait", "upstream");
+            if (!rateLimiter().acquire(cost, chrono::steady_clock::now() + maxLimiterWait)) {
+                logWarning("Gave up waiting for the upstream rate limit", {{"chunk", chunkNum}});
+                return R"({"highlights":[]})";
+            }
+        }
+
+        if (!upstreamBreaker().allow()) {
+            logWarning("Upstream circuit open, not calling", {{"chunk", chunkNum}});
             return R"({"highlights":[]})";
         }
-        out.write(jsonPayload.c_str(), jsonPayload.length());
-        out.close();
-    }
-
-    // Use PowerShell
-    string psCmd = 
-        "powershell -NoProfile -Command \""
-        "try { "
-        "$jsonBody = Get-Content -Raw -Encoding UTF8 " + tmpPath + "; "
-        "$headers = @{'Content-Type'='application/json'; 'Authorization'='Bearer " + string(key) + "'}; "
-        "$response = Invoke-WebRequest -Uri 'https://api.openai.com/v1/chat/completions' "
-        "-Method Post -Headers $headers -Body ([System.Text.Encoding]::UTF8.GetBytes($jsonBody)); "
-        "$response.Content; "
-        "} catch { "
-        "Write-Output '{\\\"highlights\\\":[]}'; "
-        "}\"";
-
-    FILE* pipe = _popen(psCmd.c_str(), "r");
-    if (!pipe) {
-        return R"({"highlights":[]})";
+
+        // Send over a pooled keep-alive connection; a duplicate only goes out
+        // if the limiter has room for it right now
+        auto started = chrono::steady_clock::now();
+        HttpResponse res;
+        {
+            TraceSpan span("attempt", "upstream", started);
+            res = hedger().run(send, [cost] { return rateLimiter().acquire(cost, chrono::steady_clock::now()); });
+            span.arg("status", res.status ? to_string(res.status) : res.error);
+        }
+        upstreamBreaker().record(res.status != 0 && res.status < 500, chrono::steady_clock::now() - started);
+        rateLimiter().observe(res);
+
+        bool retryable = res.status == 0 || res.status == 429 || res.status >= 500;
+        if (!retryable) return res.body;
+
+        string why = res.status ? "HTTP " + to_string(res.status) : res.error;
+        if (attempt >= maxRetries) {
+            logWarning("Upstream request failed", {{"chunk", chunkNum}, {"error", why}});
+            return res.status ? res.body : R"({"highlights":[]})";
+        }
+
+        // After a 429 the limiter already holds calls for retry-after; the
+        // jitter only keeps the retries from landing together.
+        chrono::milliseconds wait = res.status == 429 ? jitteredBackoff(0, retryBase, retryCap)
+                                                      : jitteredBackoff(attempt, retryBase, retryCap);
+        logWarning("Retrying upstream request", {{"chunk", chunkNum}, {"error", why}, {"retry", attempt + 1},
+                                                 {"of", maxRetries}, {"waitMs", wait.count()}});
+        TraceSpan backoff("backoff", "upstream");
+        this_thread::sleep_for(wait);
+    }
+}
+
+// ===========================
+//  Per-chunk result cache
+// ===========================
+// TOS_CACHE_MB bounds the in-memory cache; 0 turns it off.
+ChunkCache& chunkCache() {
+    static ChunkCache cache(envSize("TOS_CACHE_MB", 64) * 1024 * 1024);
+    return cache;
+}
+
+// TOS_CACHE_DIR holds the on-disk copy that survives restarts;
+// TOS_DISK_CACHE_MB caps its data file (0 turns it off).
+MappedChunkStore& diskCache() {
+    static MappedChunkStore store;
+    static bool opened = [] {
+        size_t mb = envSize("TOS_DISK_CACHE_MB", 1024);
+        if (mb == 0) return false;
+        const char* dir = getenv("TOS_CACHE_DIR");
+        string error;
+        if (!store.open(dir && *dir ? dir : "tos_cache", mb * 1024 * 1024, error)) {
+            logWarning("Disk cache disabled", {{"error", error}});
+            return false;
+        }
+        return true;
+    }();
+    (void)opened;
+    return store;
+}
+
+ChunkKey chunkKeyFor(string_view chunk) {
+    static const string context = string(kModel) + "|prompt=" + to_string(kPromptVersion) +
+                                  "|max_tokens=" + to_string(kMaxTokens);
+    return makeChunkKey(context, chunk.data(), chunk.size());
+}
+
+// ===========================
+//  Clause pre-filter
+// ===========================
+// Chunks that mention none of these terms (navigation, definitions, contact
+// details) almost never yield highlights, so they are not worth an upstream
+// call. TOS_FILTER_TERMS names a file to use instead: one term per line,
+// optionally followed by a tab and an integer weight; '#' starts a comment.
+const char* const kDefaultFilterTerms[] = {
+    // privacy and data sharing
+    "personal data", "personal information", "privacy", "cookie", "tracking", "track your",
+    "third part", "share your", "sharing", "sell your", "disclose", "advertis", "location data",
+    "biometric", "retain", "retention", "collect",
+    // liability and warranties
+    "liabilit", "liable", "indemnif", "warrant", "as is", "damages", "at your own risk",
+    "limitation of", "disclaim",
+    // fees and billing
+    "fee", "charge", "payment", "billing", "subscription", "auto-renew", "automatically renew",
+    "refund", "non-refundable", "price", "cancel",
+    // disputes
+    "arbitrat", "class action", "jury", "waive", "governing law", "jurisdiction", "dispute",
+    // account and content rights
+    "terminat", "suspend", "license", "royalty", "perpetual", "irrevocable", "sole discretion",
+    "without notice", "modify these", "change these terms", "your content", "intellectual property",
+};
+
+PhraseMatcher& clauseFilter() {
+    static PhraseMatcher matcher = [] {
+        PhraseMatcher m;
+        const char* path = getenv("TOS_FILTER_TERMS");
+        ifstream file;
+        if (path && *path) {
+            file.open(path);
+            if (!file.is_open()) logWarning("Could not read TOS_FILTER_TERMS file, using built-in terms", {{"path", path}});
+        }
+        if (file.is_open()) {
+            string line;
+            while (getline(file, line)) {
+                line = line.substr(0, line.find('#'));
+                size_t tab = line.find('\t');
+                int weight = tab == string::npos ? 1 : atoi(line.c_str() + tab + 1);
+                string term = line.substr(0, tab);
+                while (!term.empty() && isspace(static_cast<unsigned char>(term.back()))) term.pop_back();
+                if (!term.empty() && weight > 0) m.add(term, weight);
+            }
+        } else {
+            for (const char* term : kDefaultFilterTerms) m.add(term);
+        }
+        m.build();
+        return m;
+    }();
+    return matcher;
+}
+
+// TOS_FILTER_MIN_SCORE: chunks whose summed term weights fall below this are
+// skipped without a call; 0 sends every chunk.
+bool worthAnalyzing(string_view chunk) {
+    static const size_t minScore = envSize("TOS_FILTER_MIN_SCORE", 1);
+    if (minScore == 0) return true;
+    return static_cast<size_t>(clauseFilter().score(chunk)) >= minScore;
+}
+
+// ===========================
+//  Offline engine
+// ===========================
+// "engine": "offline" in a request skips the model entirely; the offline
+// ranker also answers any chunk the upstream could not (no key, transport
+// failure, error reply) unless TOS_OFFLINE_FALLBACK=0.
+enum class Engine { OpenAI, Offline };
+
+OfflineAnalyzer& offlineAnalyzer() {
+    static OfflineAnalyzer analyzer;
+    return analyzer;
+}
+
+// Reads the optional "engine" field; false if it names no known engine.
+bool parseEngine(const crow::json::rvalue& body, Engine& engine) {
+    engine = Engine::OpenAI;
+    if (!body.has("engine")) return true;
+    if (body["engine"].t() != crow::json::type::String) return false;
+    string name = body["engine"].s();
+    if (name == "offline") {
+        engine = Engine::Offline;
+    } else if (name != "openai") {
+        return false;
+    }
+    return true;
+}
+
+// Where a chunk's highlights came from, for the "meta" counts. Fallback and
+// Failed are chunks the model should have answered but could not.
+enum class ChunkSource { Model, Skipped, Offline, Fallback, Failed, Count };
+const char* const kChunkSourceNames[] = {"model", "skipped", "offline", "fallback", "failed"};
+
+Counter& chunkCounter(ChunkSource source) {
+    static Counter counters[size_t(ChunkSource::Count)];
+    return counters[size_t(source)];
+}
+
+struct ChunkTally {
+    size_t skipped = 0;
+    size_t offline = 0;
+    size_t degraded = 0;
+
+    void add(ChunkSource source) {
+        chunkCounter(source).add();
+        skipped += source == ChunkSource::Skipped;
+        offline += source == ChunkSource::Offline || source == ChunkSource::Fallback;
+        degraded += source == ChunkSource::Fallback || source == ChunkSource::Failed;
+    }
+};
+
+// ===========================
+//  Analyze one chunk (cache first)
+// ===========================
+vector<string> analyzeChunk(string_view chunk, size_t chunkNum, size_t totalChunks,
+                            Engine engine = Engine::OpenAI, ChunkSource* source = nullptr) {
+    static const bool offlineFallback = envSize("TOS_OFFLINE_FALLBACK", 1) != 0;
+    auto from = [&](ChunkSource s) {
+        if (source) *source = s;
+    };
+    TraceSpan span("chunk", "chunk");
+    span.arg("chunk", to_string(chunkNum) + "/" + to_string(totalChunks));
+
+    vector<string> highlights;
+    if (engine == Engine::Offline) {
+        from(ChunkSource::Offline);
+        TraceSpan offline("offline", "stage");
+        return offlineAnalyzer().analyze(chunk);
+    }
+    from(ChunkSource::Model);
+    if (!worthAnalyzing(chunk)) {
+        from(ChunkSource::Skipped);
+        return highlights;
+    }
+
+    ChunkKey key = chunkKeyFor(chunk);
+    {
+        TraceSpan lookup("cache lookup", "stage");
+        if (chunkCache().get(key, highlights)) {
+            lookup.arg("hit", "memory");
+            return highlights;
+        }
+        if (diskCache().get(key, highlights)) {
+            lookup.arg("hit", "disk");
+            chunkCache().put(key, highlights);
+            return highlights;
+        }
     }
 
-    char buffer[8192];
+    logInfo("Analyzing chunk", {{"chunk", chunkNum}, {"of", totalChunks}});
     string response;
-    while (fgets(buffer, sizeof(buffer), pipe)) {
-        response += buffer;
+    {
+        StageScope stage(Stage::Upstream);
+        response = callOpenAIChunk(chunk, chunkNum, totalChunks);
+    }
+    bool parsed;
+    {
+        StageScope stage(Stage::Parse);
+        parsed = extractHighlights(response, chunkNum, highlights);
+    }
+    if (parsed) {
+        chunkCache().put(key, highlights);
+        diskCache().put(key, highlights);
+    } else if (offlineFallback) {
+        from(ChunkSource::Fallback);
+        TraceSpan offline("offline", "stage");
+        return offlineAnalyzer().analyze(chunk);
+    } else {
+        from(ChunkSource::Failed);
     }
-    _pclose(pipe);
+    return highlights;
+}
 
-    // Extract JSON
-    size_t start = response.find('{');
-    size_t end = response.rfind('}');
-    if (start != string::npos && end != string::npos) {
-        response = response.substr(start, end - start + 1);
+// For pool tasks: an exception would otherwise be swallowed by the task's
+// unread future and the chunk would never report back, stalling the caller.
+// A throwing chunk counts as Failed (degraded) instead.
+vector<string> analyzeChunkInTask(string_view chunk, size_t chunkNum, size_t totalChunks, Engine engine,
+                                  ChunkSource& source) {
+    try {
+        return analyzeChunk(chunk, chunkNum, totalChunks, engine, &source);
+    } catch (const exception& e) {
+        logWarning("Chunk analysis failed", {{"chunk", chunkNum}, {"error", e.what()}});
+        source = ChunkSource::Failed;
+        return {};
     }
+}
 
-    return response;
+// ===========================
+//  Shared pool for upstream chunk calls
+// ===========================
+// TOS_MAX_INFLIGHT caps how many chunk calls run at once across all requests.
+WorkerPool& chunkPool() {
+    static WorkerPool pool(envSize("TOS_MAX_INFLIGHT", 8));
+    return pool;
+}
+
+// ===========================
+//  Merge per-chunk highlights
+// ===========================
+// Builds the /analyze reply from per-chunk results in document order.
+// Near-duplicate highlights from different chunks are merged first;
+// TOS_DEDUP_SIMILARITY is the word-pair overlap (percent) that counts as the
+// same clause, 100 merges exact repeats only and 0 turns merging off.
+// "meta" counts the chunks the pre-filter let through, the ones it skipped,
+// the ones answered by the offline engine, and the merged highlights.
+// "degraded" is set when any chunk the model should have answered was not
+// (upstream down or circuit open); "meta.chunksDegraded" says how many.
+//
+// The reply is written straight to JSON text: highlights are views into
+// perChunk and the merge works in a per-request arena, so building it costs
+// a handful of allocations however many highlights there are, instead of a
+// wvalue node and a string copy per highlight.
+string buildAnalysisResult(const vector<vector<string>>& perChunk, const ChunkTally& tally) {
+    RequestArena arena;
+    pmr::vector<string_view> highlights(arena.resource());
+    size_t merged;
+    {
+        StageScope stage(Stage::Merge);
+        size_t total = 0;
+        for (auto& chunk : perChunk) total += chunk.size();
+        highlights.reserve(total);
+        for (auto& chunk : perChunk) highlights.insert(highlights.end(), chunk.begin(), chunk.end());
+
+        static const size_t dedupPercent = envSize("TOS_DEDUP_SIMILARITY", 50);
+        merged = dedupPercent ? dedupHighlights(highlights, dedupPercent / 100.0, arena.resource()) : 0;
+        metrics().highlights.add(highlights.size());
+        metrics().documentHighlights.record(highlights.size());
+    }
+
+    StageScope stage(Stage::Serialize);
+    size_t bytes = 512;
+    for (string_view h : highlights) bytes += h.size() + h.size() / 8 + 3;
+    string out;
+    out.reserve(bytes);
+    out += "{\"summary\":\"AI analyzed ";
+    out += to_string(perChunk.size());
+    out += " sections of your Terms of Service and found ";
+    out += to_string(highlights.size());
+    out += " important clauses regarding privacy, liability, fees, and user rights.\",\"highlights\":[";
+    for (size_t i = 0; i < highlights.size(); i++) {
+        out += i ? ",\"" : "\"";
+        appendJsonEscaped(out, highlights[i]);
+        out += '"';
+    }
+    out += "],\"meta\":{\"chunks\":";
+    out += to_string(perChunk.size());
+    out += ",\"chunksAnalyzed\":";
+    out += to_string(perChunk.size() - tally.skipped);
+    out += ",\"chunksSkipped\":";
+    out += to_string(tally.skipped);
+    out += ",\"chunksOffline\":";
+    out += to_string(tally.offline);
+    out += ",\"highlightsMerged\":";
+    out += to_string(merged);
+    out += ",\"chunksDegraded\":";
+    out += to_string(tally.degraded);
+    out += "},\"degraded\":";
+    out += tally.degraded > 0 ? "true" : "false";
+    out += '}';
+    return out;
+}
+
+// `fields` and then the members of `result`, as one JSON object
+string withFields(const crow::json::wvalue& fields, const string& result) {
+    string out = fields.dump();
+    out.back() = ',';
+    out.append(result, 1, string::npos);
+    return out;
 }
 
 // ===========================
 //  Analyze entire TOS in chunks
 // ===========================
-crow::json::wvalue analyzeFullTOS(const string& tosText) {
-    crow::json::wvalue result;
-    vector<string> allHighlights;
-    
+// onChunk, if given, runs on the calling thread as each chunk finishes (in
+// completion order), before the ordered result is assembled.
+using ChunkCallback = function<void(size_t chunkIndex, size_t totalChunks, const vector<string>& highlights)>;
+
+string analyzeFullTOS(const string& tosText, const ChunkCallback& onChunk = nullptr,
+                      Engine engine = Engine::OpenAI) {
+    TraceSpan span("analyzeFullTOS", "request");
+    Trace* trace = currentTrace();
+
     // Split into chunks
-    vector<string> chunks = chunkText(tosText, 3000);
+    vector<string_view> chunks = splitDocument(tosText);
     
-    cout << "Splitting TOS into " << chunks.size() << " chunks...\n";
+    logInfo("Split TOS into chunks", {{"chunks", chunks.size()}});
     
-    // Analyze each chunk
+    // Fan the chunks out over the pool; each task files its result by index
+    // and reports completion so the caller can react before the rest finish.
+    vector<vector<string>> perChunk(chunks.size());
+    mutex doneMutex;
+    condition_variable doneCv;
+    deque<size_t> done;
+    ChunkTally tally;
     for (size_t i = 0; i < chunks.size(); i++) {
-        cout << "Analyzing chunk " << (i+1) << "/" << chunks.size() << "...\n";
-        
-        string response = callOpenAIChunk(chunks[i], i + 1, chunks.size());
-        
-        // Parse response
-        auto parsed = crow::json::load(response);
-        if (!parsed) continue;
-        
-        // Handle error
-        if (parsed.has("error")) {
-            cout << "Error in chunk " << (i+1) << "\n";
-            continue;
+        auto queued = chrono::steady_clock::now();
+        chunkPool().submit([&, i, queued] {
+            TraceBinding bind(trace);
+            { TraceSpan wait("queued", "chunk", queued); }
+            ChunkSource source;
+            vector<string> highlights = analyzeChunkInTask(chunks[i], i + 1, chunks.size(), engine, source);
+            lock_guard<mutex> lock(doneMutex);
+            tally.add(source);
+            perChunk[i] = std::move(highlights);
+            done.push_back(i);
+            doneCv.notify_one();
+        });
+    }
+
+    for (size_t finished = 0; finished < chunks.size(); finished++) {
+        unique_lock<mutex> lock(doneMutex);
+        doneCv.wait(lock, [&] { return !done.empty(); });
+        size_t i = done.front();
+        done.pop_front();
+        lock.unlock();
+        if (onChunk) onChunk(i, chunks.size(), perChunk[i]);
+    }
+
+    size_t found = 0;
+    for (auto& highlights : perChunk) found += highlights.size();
+    logInfo("Analysis complete", {{"highlights", found}, {"chunks", chunks.size()}, {"skipped", tally.skipped},
+                                  {"offline", tally.offline}, {"degraded", tally.degraded}});
+    
+    return buildAnalysisResult(perChunk, tally);
+}
+
+// ===========================
+//  Batch analysis
+// ===========================
+struct BatchDocument {
+    string id;
+    string text;
+};
+
+// All chunks of all documents share one schedule on chunkPool, so the
+// upstream stays busy across document boundaries. At most two pool-widths of
+// a batch's chunks are queued at once; that bounds the queued closures and
+// leaves interactive requests room to interleave. onDocument runs on the
+// calling thread as each document's last chunk lands; returning false stops
+// scheduling (already queued chunks still finish).
+void analyzeBatch(const vector<BatchDocument>& docs, Engine engine,
+                  const function<bool(size_t docIndex, const string& result)>& onDocument) {
+    TraceSpan span("analyzeBatch", "request");
+    Trace* trace = currentTrace();
+    vector<vector<string_view>> chunks(docs.size());
+    vector<vector<vector<string>>> perChunk(docs.size());
+    vector<size_t> remaining(docs.size());
+    vector<ChunkTally> tallies(docs.size());
+    deque<size_t> ready;
+    size_t totalChunks = 0;
+    for (size_t d = 0; d < docs.size(); d++) {
+        chunks[d] = splitDocument(docs[d].text);
+        perChunk[d].resize(chunks[d].size());
+        remaining[d] = chunks[d].size();
+        totalChunks += chunks[d].size();
+        if (chunks[d].empty()) ready.push_back(d);
+    }
+
+    logInfo("Batch started", {{"documents", docs.size()}, {"chunks", totalChunks}});
+
+    const size_t window = chunkPool().size() * 2;
+    mutex m;
+    condition_variable cv;
+    size_t inFlight = 0, delivered = 0;
+    size_t nextDoc = 0, nextChunk = 0;
+    bool keepGoing = true;
+    auto skipExhausted = [&] {
+        while (nextDoc < docs.size() && nextChunk == chunks[nextDoc].size()) {
+            nextDoc++;
+            nextChunk = 0;
         }
-        
-        // Extract highlights from choices[0].message.content
-        if (parsed.has("choices") && parsed["choices"].size() > 0) {
-            auto& choice = parsed["choices"][0];
-            if (choice.has("message") && choice["message"].has("content")) {
-                string content = choice["message"]["content"].s();
-                
-                // Parse the inner JSON
-                auto inner = crow::json::load(content);
-                if (inner && inner.has("highlights")) {
-                    auto& highlights = inner["highlights"];
-                    for (size_t j = 0; j < highlights.size(); j++) {
-                        allHighlights.push_back(highlights[j].s());
-                    }
-                }
-            }
+    };
+    skipExhausted();
+
+    unique_lock<mutex> lock(m);
+    while (delivered < docs.size() && (keepGoing || inFlight > 0)) {
+        while (keepGoing && inFlight < window && nextDoc < docs.size()) {
+            size_t d = nextDoc, i = nextChunk++;
+            skipExhausted();
+            inFlight++;
+            auto queued = chrono::steady_clock::now();
+            chunkPool().submit([&, d, i, queued] {
+                TraceBinding bind(trace);
+                { TraceSpan wait("queued", "chunk", queued); }
+                ChunkSource source;
+                vector<string> highlights = analyzeChunkInTask(chunks[d][i], i + 1, chunks[d].size(), engine, source);
+                lock_guard<mutex> guard(m);
+                tallies[d].add(source);
+                perChunk[d][i] = std::move(highlights);
+                inFlight--;
+                if (--remaining[d] == 0) ready.push_back(d);
+                cv.notify_one();
+            });
+        }
+
+        cv.wait(lock, [&] {
+            return !ready.empty() || inFlight == 0 || (keepGoing && inFlight < window && nextDoc < docs.size());
+        });
+
+        while (!ready.empty()) {
+            size_t d = ready.front();
+            ready.pop_front();
+            lock.unlock();
+            string result = buildAnalysisResult(perChunk[d], tallies[d]);
+            vector<vector<string>>().swap(perChunk[d]);
+            bool more = onDocument(d, result);
+            lock.lock();
+            delivered++;
+            if (!more) keepGoing = false;
         }
     }
-    
-    // Build final response
-    result["summary"] = "AI analyzed " + to_string(chunks.size()) + 
-                       " sections of your Terms of Service and found " + 
-                       to_string(allHighlights.size()) + 
-                       " important clauses regarding privacy, liability, fees, and user rights.";
-    
-    for (size_t i = 0; i < allHighlights.size(); i++) {
-        result["highlights"][i] = allHighlights[i];
+    // Queued tasks reference this frame
+    cv.wait(lock, [&] { return inFlight == 0; });
+
+    logInfo("Batch complete", {{"delivered", delivered}, {"documents", docs.size()}});
+}
+
+// ===========================
+//  Coalesce duplicate documents
+// ===========================
+// A shared ToS tends to arrive as a burst of identical bodies. The first one
+// runs the analysis; copies that come in while it is still running wait for
+// it and get the same result instead of fanning out their own chunk calls.
+SingleFlight<ChunkKey, string, ChunkKeyHash>& documentFlights() {
+    static SingleFlight<ChunkKey, string, ChunkKeyHash> flights;
+    return flights;
+}
+
+// onChunk only fires for the caller that ends up running the analysis.
+string analyzeDocument(const string& tosText, const ChunkCallback& onChunk = nullptr,
+                       Engine engine = Engine::OpenAI) {
+    ChunkKey key = makeChunkKey(engine == Engine::Offline ? "document|offline" : "document",
+                                tosText.data(), tosText.size());
+    TraceSpan span("analyzeDocument", "request");
+    return documentFlights().run(key, [&] { return analyzeFullTOS(tosText, onChunk, engine); });
+}
+
+// ===========================
+//  Server-Sent Events framing
+// ===========================
+string sseEvent(const string& event, const string& data) {
+    return "event: " + event + "\ndata: " + data + "\n\n";
+}
+
+// ===========================
+//  Pool for whole-document analyses
+// ===========================
+// Every analysis (HTTP, SSE, WebSocket, jobs) runs here rather than on a Crow
+// I/O thread. Kept apart from chunkPool so a running analysis never waits on
+// its own pool.
+WorkerPool& analysisPool() {
+    static WorkerPool pool(envSize("TOS_MAX_ANALYSES", 16));
+    return pool;
+}
+
+// For response::body_stream_executor: streamed replies produce their body
+// here while Crow keeps the socket on its I/O thread.
+void runOnAnalysisPool(function<void()> produce) {
+    analysisPool().submit(std::move(produce));
+}
+
+// ===========================
+//  Deferred HTTP responses
+// ===========================
+// Completes a response whose handler returned without calling end(). The
+// write is handed back to the connection's own I/O thread.
+void completeOnIoThread(crow::asio::io_context* io, crow::response& res, int code, string json) {
+    crow::asio::post(*io, [&res, code, json = std::move(json)]() mutable {
+        res.code = code;
+        res.set_header("Content-Type", "application/json");
+        res.add_header("Access-Control-Allow-Origin", "*");
+        res.body = std::move(json);
+        res.end();
+    });
+}
+
+// ===========================
+//  Analysis jobs
+// ===========================
+// TOS_JOB_TTL_S: how long a finished job's result stays fetchable.
+JobStore& jobStore() {
+    static JobStore store(chrono::seconds(envSize("TOS_JOB_TTL_S", 600)));
+    return store;
+}
+
+// ===========================
+//  WebSocket analysis sessions
+// ===========================
+// One per socket, created in onopen and reached through conn.userdata().
+// Background analyses hold a shared_ptr to it rather than to the socket, so
+// once onclose has run (under the same lock) their frames are dropped, even
+// if a new socket is allocated at the old address.
+// TOS_WS_MAX_ANALYSES: analyses one socket may have running or queued.
+class WsSession {
+public:
+    explicit WsSession(crow::websocket::connection* conn) : conn_(conn) {}
+
+    void close() {
+        lock_guard<mutex> lock(mutex_);
+        conn_ = nullptr;
     }
-    
-    cout << "Analysis complete. Found " << allHighlights.size() << " total highlights.\n";
-    
-    return result;
+
+    bool send(const string& message) {
+        lock_guard<mutex> lock(mutex_);
+        if (!conn_) return false;
+        conn_->send_text(message);
+        return true;
+    }
+
+    // Reserves a slot for one more analysis; false when the socket is at the cap.
+    bool tryStart() {
+        static const size_t maxAnalyses = max<size_t>(envSize("TOS_WS_MAX_ANALYSES", 4), 1);
+        lock_guard<mutex> lock(mutex_);
+        if (running_ >= maxAnalyses) return false;
+        running_++;
+        return true;
+    }
+
+    void finish() {
+        lock_guard<mutex> lock(mutex_);
+        running_--;
+    }
+
+private:
+    mutex mutex_;
+    crow::websocket::connection* conn_;
+    size_t running_ = 0;
+};
+
+// The session installed by onopen (the connection's own thread only)
+shared_ptr<WsSession> wsSession(crow::websocket::connection& conn) {
+    auto* session = static_cast<shared_ptr<WsSession>*>(conn.userdata());
+    return session ? *session : nullptr;
+}
+
+// Runs one /ws/analyze request: a "progress" frame per finished chunk, then a
+// "result" frame with the same object POST /analyze returns.
+void runWsAnalysis(WsSession& session, const string& id, const string& text, Engine engine) {
+    size_t progressed = 0;
+    string result = analyzeFullTOS(text, [&](size_t i, size_t total, const vector<string>& highlights) {
+        crow::json::wvalue frame;
+        frame["type"] = "progress";
+        frame["id"] = id;
+        frame["chunk"] = i + 1;
+        frame["done"] = ++progressed;
+        frame["total"] = total;
+        frame["highlights"] = crow::json::wvalue::list();
+        for (size_t j = 0; j < highlights.size(); j++) {
+            frame["highlights"][j] = highlights[j];
+        }
+        session.send(frame.dump());
+    }, engine);
+
+    crow::json::wvalue fields;
+    fields["type"] = "result";
+    fields["id"] = id;
+    session.send(withFields(fields, result));
 }
 
 // ===========================
 //          MAIN
 // ===========================
 int main() {
+    crow::logger::setHandler(&logSink());
     crow::SimpleApp app;
 
     // CORS headers
@@ -192,33 +927,436 @@ int main() {
         auto res = crow::response(200);
         res.add_header("Access-Control-Allow-Origin", "*");
         res.add_header("Access-Control-Allow-Methods", "POST, OPTIONS");
-        res.add_header("Access-Control-Allow-Headers", "Content-Type");
+        res.add_header("Access-Control-Allow-Headers", "Content-Type, X-Trace");
         return res;
     });
 
-    // POST /analyze
+    // POST /analyze - the analysis runs on analysisPool and the response is
+    // completed from there, so the Crow I/O thread is free in the meantime
     CROW_ROUTE(app, "/analyze").methods(crow::HTTPMethod::Post)
+    ([](const crow::request& req, crow::response& res) {
+        auto body = crow::json::load(req.body);
+        Engine engine;
+
+        if (!body || !body.has("tosText") || !parseEngine(body, engine)) {
+            res.code = 400;
+            res.body = "Invalid JSON";
+            res.add_header("Access-Control-Allow-Origin", "*");
+            res.end();
+            return;
+        }
+
+        string text = body["tosText"].s();
+        shared_ptr<Trace> trace = maybeTrace(req);
+        auto arrived = chrono::steady_clock::now();
+        addTraceHeaders(res, trace);
+        
+        logInfo("Received TOS", {{"characters", text.length()}});
+
+        // Accept: text/event-stream - one "chunk" event per finished chunk,
+        // then a "summary" event carrying the same object as the JSON reply.
+        // The stream is written by the pool thread that runs the analysis.
+        if (req.get_header_value("Accept").find("text/event-stream") != string::npos) {
+            res.set_header("Content-Type", "text/event-stream");
+            res.set_header("Cache-Control", "no-cache");
+            res.add_header("Access-Control-Allow-Origin", "*");
+            res.body_stream = [text, engine, arrived, trace](const function<bool(const string&)>& send) {
+                RequestScope scope(Route::AnalyzeStream, arrived);
+                TraceBinding bind(trace.get());
+                { TraceSpan wait("queued", "request", arrived); }
+                string result = analyzeFullTOS(text, [&](size_t i, size_t total, const vector<string>& highlights) {
+                    crow::json::wvalue ev;
+                    ev["chunk"] = i + 1;
+                    ev["total"] = total;
+                    ev["highlights"] = crow::json::wvalue::list();
+                    for (size_t j = 0; j < highlights.size(); j++) {
+                        ev["highlights"][j] = highlights[j];
+                    }
+                    send(sseEvent("chunk", ev.dump()));
+                }, engine);
+                send(sseEvent("summary", result));
+            };
+            // The producer runs on analysisPool; Crow writes each event from
+            // the connection's I/O thread. end() is posted so Crow is done
+            // with the handler before the stream starts.
+            res.body_stream_executor = runOnAnalysisPool;
+            crow::asio::post(*req.io_context, [&res] { res.end(); });
+            return;
+        }
+
+        // Analyze with chunking
+        crow::asio::io_context* io = req.io_context;
+        analysisPool().submit([&res, io, text, engine, arrived, trace] {
+            RequestScope scope(Route::Analyze, arrived);
+            TraceBinding bind(trace.get());
+            { TraceSpan wait("queued", "request", arrived); }
+            completeOnIoThread(io, res, 200, analyzeDocument(text, nullptr, engine));
+        });
+    });
+
+    // CORS preflight for batches
+    CROW_ROUTE(app, "/analyze/batch").methods(crow::HTTPMethod::Options)
+    ([]() {
+        auto res = crow::response(200);
+        res.add_header("Access-Control-Allow-Origin", "*");
+        res.add_header("Access-Control-Allow-Methods", "POST, OPTIONS");
+        res.add_header("Access-Control-Allow-Headers", "Content-Type, X-Trace");
+        return res;
+    });
+
+    // POST /analyze/batch - {"documents": ["text", {"id": ..., "tosText": "text"}, ...]}
+    // Streams back one JSON line per document (application/x-ndjson) in the
+    // order they finish: {"index", "id", "summary", "highlights"}.
+    CROW_ROUTE(app, "/analyze/batch").methods(crow::HTTPMethod::Post)
+    ([](const crow::request& req, crow::response& res) {
+        static const size_t maxBatch = envSize("TOS_MAX_BATCH", 1000);
+        auto body = crow::json::load(req.body);
+        auto reject = [&res](const string& why) {
+            res.code = 400;
+            res.body = why;
+            res.add_header("Access-Control-Allow-Origin", "*");
+            res.end();
+        };
+
+        Engine engine;
+        if (!body || !body.has("documents") || body["documents"].t() != crow::json::type::List ||
+            !parseEngine(body, engine)) {
+            reject("Invalid JSON");
+            return;
+        }
+        if (body["documents"].size() > maxBatch) {
+            reject("Too many documents (max " + to_string(maxBatch) + ")");
+            return;
+        }
+
+        auto docs = make_shared<vector<BatchDocument>>();
+        docs->reserve(body["documents"].size());
+        for (auto& item : body["documents"]) {
+            BatchDocument doc;
+            if (item.t() == crow::json::type::String) {
+                doc.text = item.s();
+            } else if (item.t() == crow::json::type::Object && item.has("tosText") &&
+                       item["tosText"].t() == crow::json::type::String) {
+                doc.text = item["tosText"].s();
+                if (item.has("id")) {
+                    doc.id = item["id"].t() == crow::json::type::String ? string(item["id"].s())
+                                                                       : crow::json::wvalue(item["id"]).dump();
+                }
+            } else {
+                reject("Invalid document at index " + to_string(docs->size()));
+                return;
+            }
+            if (doc.id.empty()) doc.id = to_string(docs->size());
+            docs->push_back(std::move(doc));
+        }
+
+        logInfo("Received batch", {{"documents", docs->size()}});
+
+        res.set_header("Content-Type", "application/x-ndjson");
+        res.add_header("Access-Control-Allow-Origin", "*");
+        shared_ptr<Trace> trace = maybeTrace(req);
+        auto arrived = chrono::steady_clock::now();
+        addTraceHeaders(res, trace);
+        res.body_stream = [docs, engine, arrived, trace](const function<bool(const string&)>& send) {
+            RequestScope scope(Route::Batch, arrived);
+            TraceBinding bind(trace.get());
+            { TraceSpan wait("queued", "request", arrived); }
+            analyzeBatch(*docs, engine, [&](size_t d, const string& result) {
+                crow::json::wvalue fields;
+                fields["index"] = d;
+                fields["id"] = (*docs)[d].id;
+                return send(withFields(fields, result) + "\n");
+            });
+        };
+        res.body_stream_executor = runOnAnalysisPool;
+        crow::asio::post(*req.io_context, [&res] { res.end(); });
+    });
+
+    // CORS preflight for the job API
+    CROW_ROUTE(app, "/jobs").methods(crow::HTTPMethod::Options)
+    ([]() {
+        auto res = crow::response(200);
+        res.add_header("Access-Control-Allow-Origin", "*");
+        res.add_header("Access-Control-Allow-Methods", "GET, POST, OPTIONS");
+        res.add_header("Access-Control-Allow-Headers", "Content-Type, X-Trace");
+        return res;
+    });
+
+    // POST /jobs - queue an analysis and return its id right away
+    CROW_ROUTE(app, "/jobs").methods(crow::HTTPMethod::Post)
     ([](const crow::request& req) {
         auto body = crow::json::load(req.body);
+        Engine engine;
 
-        if (!body || !body.has("tosText")) {
+        if (!body || !body.has("tosText") || !parseEngine(body, engine)) {
             auto res = crow::response(400, "Invalid JSON");
             res.add_header("Access-Control-Allow-Origin", "*");
             return res;
         }
 
         string text = body["tosText"].s();
-        
-        cout << "Received TOS with " << text.length() << " characters\n";
+        string id = jobStore().create();
+        logInfo("Queued job", {{"job", id}, {"characters", text.length()}});
 
-        // Analyze with chunking
-        crow::json::wvalue result = analyzeFullTOS(text);
-        
-        auto response = crow::response(result);
-        response.add_header("Access-Control-Allow-Origin", "*");
-        return response;
+        shared_ptr<Trace> trace = maybeTrace(req);
+        auto arrived = chrono::steady_clock::now();
+        analysisPool().submit([id, text, engine, arrived, trace] {
+            RequestScope scope(Route::Job, arrived);
+            TraceBinding bind(trace.get());
+            { TraceSpan wait("queued", "request", arrived); }
+            jobStore().start(id);
+            size_t done = 0;
+            try {
+                string result = analyzeDocument(text, [&](size_t, size_t total, const vector<string>&) {
+                    jobStore().progress(id, ++done, total);
+                }, engine);
+                jobStore().finish(id, crow::json::wvalue(crow::json::load(result)));
+            } catch (const exception& e) {
+                jobStore().fail(id, e.what());
+            }
+        });
+
+        crow::json::wvalue out;
+        out["id"] = id;
+        out["status"] = "queued";
+        out["poll"] = "/jobs/" + id;
+        auto res = crow::response(202, out);
+        res.add_header("Access-Control-Allow-Origin", "*");
+        addTraceHeaders(res, trace);
+        return res;
+    });
+
+    // GET /jobs/<id>[?wait=seconds] - status and, once done, the result.
+    // With wait, the reply is held (without a thread) until the job finishes
+    // or the wait runs out, whichever comes first.
+    CROW_ROUTE(app, "/jobs/<string>").methods(crow::HTTPMethod::Get)
+    ([](const crow::request& req, crow::response& res, const string& id) {
+        const char* waitParam = req.url_params.get("wait");
+        long waitSeconds = waitParam ? min(max(atol(waitParam), 0L), 60L) : 0;
+
+        crow::asio::io_context* io = req.io_context;
+        auto deadline = JobStore::Clock::now() + chrono::seconds(waitSeconds);
+        bool known = jobStore().wait(id, deadline, [&res, io](const JobStore::Snapshot& snap) {
+            completeOnIoThread(io, res, 200, snap.toJson().dump());
+        });
+        if (!known) {
+            res.code = 404;
+            res.body = "Unknown job";
+            res.add_header("Access-Control-Allow-Origin", "*");
+            res.end();
+        }
+    });
+
+    // WebSocket /ws/analyze - send {"id": "...", "tosText": "..."} any number of
+    // times; each one is analyzed in the background and answered with frames
+    // tagged with its id, so several analyses can share one socket (up to
+    // TOS_WS_MAX_ANALYSES at once; past that a message gets an error frame).
+    CROW_WEBSOCKET_ROUTE(app, "/ws/analyze")
+    .onopen([](crow::websocket::connection& conn) {
+        conn.userdata(new shared_ptr<WsSession>(make_shared<WsSession>(&conn)));
+    })
+    .onclose([](crow::websocket::connection& conn, const string&, uint16_t) {
+        // Crow may call this twice for one socket
+        auto* session = static_cast<shared_ptr<WsSession>*>(conn.userdata());
+        if (!session) return;
+        (*session)->close();
+        delete session;
+        conn.userdata(nullptr);
+    })
+    .onmessage([](crow::websocket::connection& conn, const string& data, bool) {
+        static atomic<uint64_t> nextId{1};
+        shared_ptr<WsSession> session = wsSession(conn);
+        if (!session) return;
+        auto msg = crow::json::load(data);
+        bool object = msg && msg.t() == crow::json::type::Object;
+        string id;
+        if (object && msg.has("id")) {
+            id = msg["id"].t() == crow::json::type::String ? string(msg["id"].s()) : crow::json::wvalue(msg["id"]).dump();
+        } else {
+            id = to_string(nextId++);
+        }
+
+        Engine engine;
+        if (!object || !msg.has("tosText") || msg["tosText"].t() != crow::json::type::String ||
+            !parseEngine(msg, engine)) {
+            crow::json::wvalue err;
+            err["type"] = "error";
+            err["id"] = id;
+            err["error"] = "Invalid JSON";
+            session->send(err.dump());
+            return;
+        }
+        if (!session->tryStart()) {
+            crow::json::wvalue err;
+            err["type"] = "error";
+            err["id"] = id;
+            err["error"] = "Too many analyses in progress on this connection";
+            session->send(err.dump());
+            return;
+        }
+
+        string text = msg["tosText"].s();
+        logInfo("Received TOS over WebSocket", {{"characters", text.length()}});
+
+        auto arrived = chrono::steady_clock::now();
+        analysisPool().submit([session, id, text, engine, arrived] {
+            RequestScope scope(Route::WebSocket, arrived);
+            try {
+                runWsAnalysis(*session, id, text, engine);
+            } catch (const exception& e) {
+                logWarning("WebSocket analysis failed", {{"error", e.what()}});
+                crow::json::wvalue err;
+                err["type"] = "error";
+                err["id"] = id;
+                err["error"] = "Analysis failed";
+                session->send(err.dump());
+            }
+            session->finish();
+        });
+    });
+
+    // GET /cache/stats - sizing info for the chunk caches
+    CROW_ROUTE(app, "/cache/stats")
+    ([]() {
+        ChunkCache::Stats st = chunkCache().stats();
+        crow::json::wvalue out;
+        out["hits"] = st.hits;
+        out["misses"] = st.misses;
+        out["inserts"] = st.inserts;
+        out["evictions"] = st.evictions;
+        out["entries"] = st.entries;
+        out["bytes"] = st.bytes;
+        out["capacityBytes"] = st.capacityBytes;
+        uint64_t lookups = st.hits + st.misses;
+        out["hitRate"] = lookups ? double(st.hits) / lookups : 0.0;
+
+        MappedChunkStore::Stats disk = diskCache().stats();
+        out["disk"]["enabled"] = diskCache().enabled();
+        out["disk"]["hits"] = disk.hits;
+        out["disk"]["misses"] = disk.misses;
+        out["disk"]["entries"] = disk.entries;
+        out["disk"]["dataBytes"] = disk.dataBytes;
+        out["disk"]["capacityBytes"] = disk.capacityBytes;
+
+        auto flights = documentFlights().stats();
+        out["coalesced"]["leaders"] = flights.leaders;
+        out["coalesced"]["followers"] = flights.followers;
+        out["coalesced"]["inFlight"] = flights.inFlight;
+        return out;
+    });
+
+    // GET /upstream/stats - connection reuse, rate limiter, hedging and breaker state
+    CROW_ROUTE(app, "/upstream/stats")
+    ([]() {
+        crow::json::wvalue out;
+        UpstreamClient* client = upstream();
+        out["baseUrl"] = client ? client->url().host + ":" + client->url().port + client->url().basePath : "";
+        out["connectionsOpened"] = client ? client->connectionsOpened() : 0;
+
+        RateLimiter::Stats rl = rateLimiter().stats();
+        out["rateLimit"]["requestsPerMinute"] = rl.requestsPerMinute;
+        out["rateLimit"]["tokensPerMinute"] = rl.tokensPerMinute;
+        out["rateLimit"]["rateFactor"] = rl.rateFactor;
+        out["rateLimit"]["throttledCalls"] = rl.waits;
+        out["rateLimit"]["rateLimited"] = rl.rateLimited;
+
+        HedgedCaller::Stats hs = hedger().stats();
+        out["hedging"]["enabled"] = hedger().enabled();
+        out["hedging"]["calls"] = hs.calls;
+        out["hedging"]["hedges"] = hs.hedges;
+        out["hedging"]["hedgeWins"] = hs.hedgeWins;
+        out["hedging"]["skippedBudget"] = hs.skippedBudget;
+        out["hedging"]["delayMs"] = hs.delayMs;
+
+        CircuitBreaker::Stats bs = upstreamBreaker().stats();
+        out["breaker"]["state"] = CircuitBreaker::name(bs.state);
+        out["breaker"]["trips"] = bs.trips;
+        out["breaker"]["rejected"] = bs.rejected;
+        out["breaker"]["recentCalls"] = bs.recentCalls;
+        out["breaker"]["recentFailures"] = bs.recentFailures;
+        return out;
+    });
+
+    // GET /debug/traces - ids of the kept traces, newest first
+    CROW_ROUTE(app, "/debug/traces")
+    ([]() {
+        crow::json::wvalue out;
+        out["traces"] = crow::json::wvalue::list();
+        vector<string> ids = traceStore().ids();
+        for (size_t i = 0; i < ids.size(); i++) out["traces"][i] = ids[i];
+        return out;
+    });
+
+    // GET /debug/traces/<id> - Chrome trace-event JSON; open it in
+    // chrome://tracing or ui.perfetto.dev
+    CROW_ROUTE(app, "/debug/traces/<string>")
+    ([](const string& id) {
+        shared_ptr<Trace> trace = traceStore().get(id);
+        if (!trace) return crow::response(404, "Unknown trace");
+        auto res = crow::response(200, trace->toJson());
+        res.add_header("Access-Control-Allow-Origin", "*");
+        return res;
+    });
+
+    // GET /metrics - Prometheus text format
+    CROW_ROUTE(app, "/metrics")
+    ([]() {
+        static const vector<double> secondsBounds = {0.000001, 0.000005, 0.00001, 0.00005, 0.0001, 0.0005,
+                                                     0.001, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+                                                     1, 2.5, 5, 10, 30, 60, 120};
+        static const vector<double> countBounds = {0, 1, 2, 5, 10, 20, 50, 100, 200, 500};
+        string out;
+
+        writeHeader(out, "tos_request_duration_seconds", "histogram",
+                    "Analyses from arrival (including queueing) until the result is written");
+        for (size_t r = 0; r < size_t(Route::Count); r++) {
+            writeHistogram(out, "tos_request_duration_seconds", "route=\"" + string(kRouteNames[r]) + "\"",
+                           metrics().requests[r].snapshot(), 1e-9, secondsBounds);
+        }
+        writeHeader(out, "tos_stage_duration_seconds", "histogram",
+                    "Time per stage: chunking and merge per document, payload/upstream/parse per chunk, serialize per result");
+        for (size_t st = 0; st < size_t(Stage::Count); st++) {
+            writeHistogram(out, "tos_stage_duration_seconds", "stage=\"" + string(kStageNames[st]) + "\"",
+                           metrics().stages[st].snapshot(), 1e-9, secondsBounds);
+        }
+
+        writeHeader(out, "tos_requests_in_flight", "gauge", "Analyses running now");
+        writeSample(out, "tos_requests_in_flight", "", metrics().inFlight.value());
+        writeHeader(out, "tos_queue_depth", "gauge", "Tasks waiting for a worker");
+        writeSample(out, "tos_queue_depth", "pool=\"analysis\"", analysisPool().queued());
+        writeSample(out, "tos_queue_depth", "pool=\"chunk\"", chunkPool().queued());
+
+        writeHeader(out, "tos_highlights_total", "counter", "Highlights returned, after merging");
+        writeSample(out, "tos_highlights_total", "", metrics().highlights.value());
+        writeHeader(out, "tos_document_highlights", "histogram", "Highlights per analyzed document");
+        writeHistogram(out, "tos_document_highlights", "", metrics().documentHighlights.snapshot(), 1, countBounds);
+        writeHeader(out, "tos_chunks_total", "counter", "Chunks analyzed, by where the answer came from");
+        for (size_t c = 0; c < size_t(ChunkSource::Count); c++) {
+            writeSample(out, "tos_chunks_total", "source=\"" + string(kChunkSourceNames[c]) + "\"",
+                        chunkCounter(ChunkSource(c)).value());
+        }
+
+        HedgedCaller::Stats hs = hedger().stats();
+        writeHeader(out, "tos_upstream_calls_total", "counter", "Chunk call attempts sent upstream, not counting hedges");
+        writeSample(out, "tos_upstream_calls_total", "", hs.calls);
+        writeHeader(out, "tos_upstream_hedges_total", "counter", "Duplicate requests sent for slow chunk calls");
+        writeSample(out, "tos_upstream_hedges_total", "", hs.hedges);
+        writeHeader(out, "tos_upstream_rate_limited_total", "counter", "429 replies from the upstream");
+        writeSample(out, "tos_upstream_rate_limited_total", "", rateLimiter().stats().rateLimited);
+        AsyncLog::Stats ls = logSink().stats();
+        writeHeader(out, "tos_log_lines_total", "counter", "Log lines written by the asynchronous log sink");
+        writeSample(out, "tos_log_lines_total", "", ls.written);
+        writeHeader(out, "tos_log_dropped_total", "counter", "Log lines dropped because the log buffer was full");
+        writeSample(out, "tos_log_dropped_total", "", ls.dropped);
+        CircuitBreaker::Stats bs = upstreamBreaker().stats();
+        writeHeader(out, "tos_circuit_breaker_open", "gauge", "1 while the upstream circuit breaker is open or half-open");
+        writeSample(out, "tos_circuit_breaker_open", "", bs.state == CircuitBreaker::State::Closed ? 0 : 1);
+
+        auto res = crow::response(200, out);
+        res.set_header("Content-Type", "text/plain; version=0.0.4");
+        return res;
     });
 
-    cout << "Starting TOS Analyzer with OpenAI chunking on port 8080...\n";
+    logInfo("Starting TOS Analyzer with OpenAI chunking", {{"port", 8080}});
     app.port(8080).multithreaded().run();
 }
\ No newline at end of file
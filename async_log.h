@@ -0,0 +1,283 @@
+#pragma once
+
+#include "crow_all.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+// ===========================
+//  Asynchronous log sink
+// ===========================
+// Request threads never touch stdout. A log line is copied into a slot of a
+// fixed ring, and a background thread formats the lines and writes them in
+// batches. Slots are claimed with one CAS (a bounded MPSC queue with per-slot
+// sequence numbers), so writers take no lock and never wait on the terminal.
+// When the ring is full the line is dropped and counted instead of blocking;
+// the flusher reports the count. Memory is fixed at slots x kLineBytes.
+//
+// Plugged into Crow with crow::logger::setHandler, so CROW_LOG_* lines take
+// the same path. event() adds logfmt-style key=value fields.
+
+// One key=value field of a log event. Numbers are formatted on the caller's
+// stack; strings are borrowed for the duration of the call.
+class LogField {
+public:
+    LogField(const char* key, std::string_view value) : key_(key), text_(value) {}
+    LogField(const char* key, const std::string& value) : key_(key), text_(value) {}
+    LogField(const char* key, const char* value) : key_(key), text_(value) {}
+
+    template <typename T, typename std::enable_if<std::is_integral<T>::value, int>::type = 0>
+    LogField(const char* key, T value) : key_(key) {
+        int n = std::is_signed<T>::value
+                    ? std::snprintf(digits_, sizeof(digits_), "%lld", static_cast<long long>(value))
+                    : std::snprintf(digits_, sizeof(digits_), "%llu", static_cast<unsigned long long>(value));
+        digitCount_ = static_cast<size_t>(n);
+    }
+
+    LogField(const char* key, double value) : key_(key) {
+        digitCount_ = static_cast<size_t>(std::snprintf(digits_, sizeof(digits_), "%.6g", value));
+    }
+
+    const char* key() const { return key_; }
+    std::string_view value() const { return digitCount_ ? std::string_view(digits_, digitCount_) : text_; }
+    bool numeric() const { return digitCount_ != 0; }
+
+private:
+    const char* key_;
+    std::string_view text_;
+    char digits_[24];
+    size_t digitCount_ = 0;
+};
+
+class AsyncLog : public crow::ILogHandler {
+public:
+    static constexpr size_t kLineBytes = 448; // longer lines are cut short
+    static constexpr size_t kBatchBytes = 64 * 1024;
+
+    struct Stats {
+        uint64_t written, dropped, truncated;
+    };
+
+    // `slots` is rounded up to a power of two.
+    AsyncLog(size_t slots, FILE* out) : out_(out) {
+        size_t n = 64;
+        while (n < slots) n <<= 1;
+        mask_ = n - 1;
+        slots_.reset(new Slot[n]);
+        for (size_t i = 0; i < n; i++) slots_[i].seq.store(i, std::memory_order_relaxed);
+        flusher_ = std::thread([this] { flushLoop(); });
+    }
+
+    // Drains what is queued, then stops the flusher.
+    ~AsyncLog() {
+        stopping_.store(true, std::memory_order_release);
+        flusher_.join();
+    }
+
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+    // Crow's entry point; the level was already filtered by crow::logger.
+    void log(const std::string& message, crow::LogLevel level) override {
+        size_t pos;
+        Slot* slot = claim(pos);
+        if (!slot) return;
+        begin(*slot, level);
+        append(*slot, message);
+        publish(*slot, pos);
+    }
+
+    // "message key=value key2=value2", skipped below Crow's log level.
+    void event(crow::LogLevel level, std::string_view message, std::initializer_list<LogField> fields = {}) {
+        if (level < crow::logger::get_current_log_level()) return;
+        size_t pos;
+        Slot* slot = claim(pos);
+        if (!slot) return;
+        begin(*slot, level);
+        append(*slot, message);
+        for (auto& f : fields) {
+            append(*slot, " ");
+            append(*slot, f.key());
+            append(*slot, "=");
+            appendValue(*slot, f);
+        }
+        publish(*slot, pos);
+    }
+
+    Stats stats() const {
+        return Stats{written_.load(std::memory_order_relaxed), dropped_.load(std::memory_order_relaxed),
+                     truncated_.load(std::memory_order_relaxed)};
+    }
+
+private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> seq{0};
+        crow::LogLevel level;
+        std::time_t time;
+        uint32_t length;
+        bool truncated;
+        char text[kLineBytes];
+    };
+
+    // A free slot for the caller to fill, or nullptr (and a drop) when the
+    // flusher has fallen a whole ring behind.
+    Slot* claim(size_t& pos) {
+        pos = tail_.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = slots_[pos & mask_];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) return &slot;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            } else {
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void publish(Slot& slot, size_t pos) {
+        if (slot.truncated) truncated_.fetch_add(1, std::memory_order_relaxed);
+        slot.seq.store(pos + 1, std::memory_order_release);
+    }
+
+    static void begin(Slot& slot, crow::LogLevel level) {
+        slot.level = level;
+        slot.time = std::time(nullptr);
+        slot.length = 0;
+        slot.truncated = false;
+    }
+
+    static void append(Slot& slot, std::string_view s) {
+        size_t room = kLineBytes - slot.length;
+        if (s.size() > room) {
+            s = s.substr(0, room);
+            slot.truncated = true;
+        }
+        std::memcpy(slot.text + slot.length, s.data(), s.size());
+        slot.length += static_cast<uint32_t>(s.size());
+    }
+
+    // Bare when unambiguous, otherwise quoted with " and \ escaped
+    static void appendValue(Slot& slot, const LogField& field) {
+        std::string_view v = field.value();
+        bool quote = !field.numeric() && (v.empty() || v.find_first_of(" \"=\\\n\t") != std::string_view::npos);
+        if (!quote) return append(slot, v);
+        append(slot, "\"");
+        size_t run = 0;
+        for (size_t i = 0; i < v.size(); i++) {
+            const char* escaped = v[i] == '"' ? "\\\"" : v[i] == '\\' ? "\\\\" : v[i] == '\n' ? "\\n" : nullptr;
+            if (!escaped) continue;
+            append(slot, v.substr(run, i - run));
+            append(slot, escaped);
+            run = i + 1;
+        }
+        append(slot, v.substr(run));
+        append(slot, "\"");
+    }
+
+    static const char* levelName(crow::LogLevel level) {
+        switch (level) {
+        case crow::LogLevel::Debug: return "DEBUG   ";
+        case crow::LogLevel::Info: return "INFO    ";
+        case crow::LogLevel::Warning: return "WARNING ";
+        case crow::LogLevel::Error: return "ERROR   ";
+        case crow::LogLevel::Critical: return "CRITICAL";
+        }
+        return "";
+    }
+
+    // Same layout and clock as Crow's CerrLogHandler (UTC unless
+    // CROW_USE_LOCALTIMEZONE): "(YYYY-mm-dd HH:MM:SS) [INFO    ] text"
+    void format(std::string& batch, std::time_t t, crow::LogLevel level, std::string_view text) {
+        if (t != stampTime_) {
+            std::tm tm;
+#if defined(_MSC_VER) || defined(__MINGW32__)
+#ifdef CROW_USE_LOCALTIMEZONE
+            localtime_s(&tm, &t);
+#else
+            gmtime_s(&tm, &t);
+#endif
+#else
+#ifdef CROW_USE_LOCALTIMEZONE
+            localtime_r(&t, &tm);
+#else
+            gmtime_r(&t, &tm);
+#endif
+#endif
+            stampLength_ = std::strftime(stamp_, sizeof(stamp_), "%Y-%m-%d %H:%M:%S", &tm);
+            stampTime_ = t;
+        }
+        batch += '(';
+        batch.append(stamp_, stampLength_);
+        batch += ") [";
+        batch += levelName(level);
+        batch += "] ";
+        batch.append(text.data(), text.size());
+        batch += '\n';
+    }
+
+    // Copies out published lines (in claim order) up to kBatchBytes, then
+    // writes them with one fwrite. Sleeps longer the longer the ring stays
+    // empty.
+    void flushLoop() {
+        std::string batch;
+        uint64_t droppedReported = 0;
+        auto idle = std::chrono::milliseconds(1);
+        for (;;) {
+            bool stopping = stopping_.load(std::memory_order_acquire);
+            batch.clear();
+            uint64_t lines = 0;
+            while (batch.size() < kBatchBytes) {
+                Slot& slot = slots_[head_ & mask_];
+                if (slot.seq.load(std::memory_order_acquire) != head_ + 1) break;
+                format(batch, slot.time, slot.level, std::string_view(slot.text, slot.length));
+                if (slot.truncated) batch.insert(batch.size() - 1, "...");
+                slot.seq.store(head_ + mask_ + 1, std::memory_order_release);
+                head_++;
+                lines++;
+            }
+            uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+            if (dropped != droppedReported) {
+                format(batch, std::time(nullptr), crow::LogLevel::Warning,
+                       "log buffer full, dropped " + std::to_string(dropped - droppedReported) + " lines");
+                droppedReported = dropped;
+            }
+            if (!batch.empty()) {
+                std::fwrite(batch.data(), 1, batch.size(), out_);
+                std::fflush(out_);
+                written_.fetch_add(lines, std::memory_order_relaxed);
+                idle = std::chrono::milliseconds(1);
+                continue;
+            }
+            if (stopping) return;
+            std::this_thread::sleep_for(idle);
+            idle = std::min(idle * 2, std::chrono::milliseconds(50));
+        }
+    }
+
+    FILE* const out_;
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    alignas(64) std::atomic<size_t> tail_{0};
+    alignas(64) size_t head_ = 0; // flusher only
+    std::atomic<uint64_t> written_{0}, dropped_{0}, truncated_{0};
+    std::atomic<bool> stopping_{false};
+    char stamp_[32];
+    size_t stampLength_ = 0;
+    std::time_t stampTime_ = 0;
+    std::thread flusher_;
+};
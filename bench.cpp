@@ -0,0 +1,264 @@
+#define CROW_MAIN
+#define CROW_USE_BOOST
+#define CROW_ENABLE_COMPRESSION
+#include "crow_all.h"
+#include "chunking.h"
+#include "openai_protocol.h"
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <new>
+#include <iostream>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// ===========================
+//  Hot-path microbenchmarks
+// ===========================
+// Times the CPU-bound steps of /analyze on synthetic Terms of Service text
+// from 1 KB to 10 MB and prints ns/op, MB/s (of input) and heap allocations
+// per op, so a change to chunking, JSON handling or compression can be
+// measured without a server or an upstream.
+//
+//   ./bench [--filter json] [--sizes 1K,64K,1M,10M] [--min-time 0.5]
+
+// ===========================
+//  Allocation counting
+// ===========================
+// Every global new goes through here; a benchmark reads the counter before
+// and after its loop.
+atomic<uint64_t> gAllocations{0};
+
+void* countedAlloc(size_t size) {
+    gAllocations.fetch_add(1, memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) return p;
+    throw bad_alloc();
+}
+
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void* operator new(size_t size, const nothrow_t&) noexcept {
+    gAllocations.fetch_add(1, memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+void* operator new[](size_t size, const nothrow_t&) noexcept {
+    gAllocations.fetch_add(1, memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// ===========================
+//  Synthetic documents
+// ===========================
+const vector<string> kClauses = {
+    "By accessing or using the Service you agree to be bound by these Terms and by our Privacy Policy.",
+    "We may collect information about your device, including IP address, browser type and operating system.",
+    "We may share your personal information with third parties for advertising and analytics purposes.",
+    "You agree to resolve any dispute through binding arbitration and waive your right to a class action.",
+    "Subscription fees are billed in advance, are non-refundable, and renew automatically unless cancelled.",
+    "The Service is provided \"as is\" without warranties of any kind, express or implied.",
+    "In no event shall the Company be liable for any indirect, incidental or consequential damages.",
+    "We may terminate or suspend your account at our sole discretion, without notice, for any reason.",
+    "You grant us a perpetual, irrevocable, royalty-free worldwide license to use your content.",
+    "We may modify these Terms at any time; continued use after changes constitutes acceptance.",
+    "You must be at least 13 years old to use the Service; users under 18 need parental consent.",
+    "Cookies and similar technologies are used to remember your preferences and measure traffic.",
+};
+
+const vector<string> kSections = {
+    "Acceptance of Terms", "Privacy and Data Collection", "Fees and Payment", "Dispute Resolution",
+    "Limitation of Liability", "Termination", "User Content", "Changes to These Terms",
+};
+
+// Numbered sections of a few paragraphs each, like a real ToS. Seeded, so
+// every run measures the same bytes.
+string makeTos(size_t bytes) {
+    mt19937_64 rng(42);
+    string out;
+    out.reserve(bytes + 256);
+    size_t section = 0;
+    while (out.size() < bytes) {
+        section++;
+        out += to_string(section) + ". " + kSections[section % kSections.size()] + "\n\n";
+        size_t paragraphs = 1 + rng() % 4;
+        for (size_t p = 0; p < paragraphs && out.size() < bytes; p++) {
+            size_t sentences = 2 + rng() % 5;
+            for (size_t s = 0; s < sentences; s++) {
+                if (s) out += ' ';
+                out += kClauses[rng() % kClauses.size()];
+            }
+            out += "\n\n";
+        }
+    }
+    out.resize(bytes);
+    return out;
+}
+
+// A chat-completions answer whose highlights add up to about `bytes`.
+string makeCompletion(size_t bytes) {
+    crow::json::wvalue inner;
+    inner["highlights"] = crow::json::wvalue::list();
+    size_t n = 0, total = 0;
+    while (total < bytes) {
+        const string& clause = kClauses[n % kClauses.size()];
+        inner["highlights"][n++] = clause;
+        total += clause.size() + 3;
+    }
+
+    crow::json::wvalue out;
+    out["object"] = "chat.completion";
+    out["model"] = kModel;
+    out["choices"][0]["index"] = 0;
+    out["choices"][0]["finish_reason"] = "stop";
+    out["choices"][0]["message"]["role"] = "assistant";
+    out["choices"][0]["message"]["content"] = inner.dump();
+    return out.dump();
+}
+
+// The payload as a wvalue, the way it was built before buildChatPayload
+crow::json::wvalue makePayloadTree(const string& tos) {
+    crow::json::wvalue payload;
+    payload["model"] = kModel;
+    payload["max_tokens"] = kMaxTokens;
+    payload["messages"][0]["role"] = "system";
+    payload["messages"][0]["content"] = kSystemPrompt;
+    payload["messages"][1]["role"] = "user";
+    payload["messages"][1]["content"] = "This is part 1 of 1 of a Terms of Service. Extract important clauses:\n\n" + tos;
+    return payload;
+}
+
+// ===========================
+//  Runner
+// ===========================
+struct Options {
+    string filter;
+    vector<size_t> sizes = {1 << 10, 16 << 10, 256 << 10, 1 << 20, 10 << 20};
+    double minTime = 0.5; // seconds per benchmark
+};
+
+void usage() {
+    cout << "usage: bench [--filter SUBSTRING] [--sizes 1K,64K,1M,10M] [--min-time 0.5]\n";
+}
+
+bool parseSizes(const string& list, vector<size_t>& out) {
+    out.clear();
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t comma = list.find(',', pos);
+        string item = list.substr(pos, comma == string::npos ? string::npos : comma - pos);
+        char* end = nullptr;
+        size_t n = strtoul(item.c_str(), &end, 10);
+        if (end == item.c_str()) return false;
+        if (*end == 'K' || *end == 'k') n <<= 10, end++;
+        else if (*end == 'M' || *end == 'm') n <<= 20, end++;
+        if (*end || n == 0) return false;
+        out.push_back(n);
+        if (comma == string::npos) break;
+        pos = comma + 1;
+    }
+    return !out.empty();
+}
+
+bool parseArgs(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (i + 1 >= argc) return false;
+        const char* v = argv[++i];
+        if (arg == "--filter") {
+            o.filter = v;
+        } else if (arg == "--sizes") {
+            if (!parseSizes(v, o.sizes)) return false;
+        } else if (arg == "--min-time") {
+            o.minTime = atof(v);
+        } else {
+            return false;
+        }
+    }
+    return o.minTime > 0;
+}
+
+string formatSize(size_t bytes) {
+    if (bytes % (1 << 20) == 0) return to_string(bytes >> 20) + "M";
+    if (bytes % (1 << 10) == 0) return to_string(bytes >> 10) + "K";
+    return to_string(bytes);
+}
+
+// Results feed this so the optimizer cannot drop the work
+volatile size_t gSink = 0;
+
+// Runs `op` (which returns something derived from its result) until
+// minTime has passed, after one untimed warm-up call. `bytes` is the input
+// size the MB/s column is computed from.
+void run(const Options& opt, const string& name, size_t bytes, const function<size_t()>& op) {
+    string label = name + "/" + formatSize(bytes);
+    if (!opt.filter.empty() && label.find(opt.filter) == string::npos) return;
+
+    gSink = gSink + op();
+    uint64_t allocsBefore = gAllocations.load(memory_order_relaxed);
+    auto start = chrono::steady_clock::now();
+    auto deadline = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(opt.minTime));
+    uint64_t iterations = 0;
+    chrono::steady_clock::time_point now;
+    do {
+        gSink = gSink + op();
+        iterations++;
+    } while ((now = chrono::steady_clock::now()) < deadline);
+    uint64_t allocs = gAllocations.load(memory_order_relaxed) - allocsBefore;
+
+    double ns = chrono::duration<double, nano>(now - start).count() / iterations;
+    printf("%-28s %10llu %14.0f %10.1f %12.1f\n", label.c_str(), static_cast<unsigned long long>(iterations), ns,
+           bytes / ns * 1e9 / (1 << 20), double(allocs) / iterations);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    printf("%-28s %10s %14s %10s %12s\n", "benchmark", "iters", "ns/op", "MB/s", "allocs/op");
+    for (size_t size : opt.sizes) {
+        const string tos = makeTos(size);
+
+        run(opt, "chunkText", size, [&] { return chunkText(tos).size(); });
+        run(opt, "chunkViews", size, [&] { return chunkViews(tos).size(); });
+        run(opt, "chunkViewsCDC", size, [&] { return chunkViewsCDC(tos).size(); });
+
+        string payload;
+        buildChatPayload(payload, tos, 1, 1);
+        run(opt, "buildChatPayload", size, [&] {
+            string out;
+            buildChatPayload(out, tos, 1, 1);
+            return out.size();
+        });
+        const crow::json::wvalue tree = makePayloadTree(tos);
+        run(opt, "wvalue::dump/payload", size, [&] { return tree.dump().size(); });
+        run(opt, "json::load/payload", size, [&] {
+            auto parsed = crow::json::load(payload);
+            return static_cast<size_t>(parsed ? parsed["messages"].size() : 0);
+        });
+
+        run(opt, "compress_string/gzip", size, [&] {
+            return crow::compression::compress_string(payload, crow::compression::GZIP).size();
+        });
+
+        const string completion = makeCompletion(size);
+        run(opt, "extractHighlights", size, [&] {
+            vector<string> highlights;
+            extractHighlights(completion, 1, highlights);
+            return highlights.size();
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,299 @@
+#pragma once
+
+#include "token_estimate.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOS_CHUNKING_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Chunkers return views into the caller's text; they stay valid for as long
+// as that string lives (the whole request, for the /analyze body).
+
+namespace chunk_detail {
+
+inline bool isSentenceEnd(char c) { return c == '.' || c == '!' || c == '?' || c == '\n'; }
+
+#ifdef TOS_CHUNKING_SSE2
+inline unsigned lowestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanForward(&i, mask);
+    return i;
+#else
+    return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+}
+
+inline unsigned highestBit(unsigned mask) {
+#if defined(_MSC_VER)
+    unsigned long i;
+    _BitScanReverse(&i, mask);
+    return i;
+#else
+    return 31u - static_cast<unsigned>(__builtin_clz(mask));
+#endif
+}
+
+// One bit per byte of p[0..16) that is a sentence terminator
+inline unsigned terminatorMask(const char* p) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('.')), _mm_cmpeq_epi8(v, _mm_set1_epi8('!'))),
+                             _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('?')), _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+    return static_cast<unsigned>(_mm_movemask_epi8(m));
+}
+#endif
+
+// Index of the first terminator in p[0..n), or n if there is none.
+inline size_t findTerminator(const char* p, size_t n) {
+    size_t i = 0;
+#ifdef TOS_CHUNKING_SSE2
+    for (; i + 16 <= n; i += 16) {
+        unsigned mask = terminatorMask(p + i);
+        if (mask) return i + lowestBit(mask);
+    }
+#endif
+    for (; i < n; i++) {
+        if (isSentenceEnd(p[i])) return i;
+    }
+    return n;
+}
+
+// Index of the last terminator in p[0..n), or n if there is none.
+inline size_t findLastTerminator(const char* p, size_t n) {
+    size_t i = n;
+#ifdef TOS_CHUNKING_SSE2
+    for (; i >= 16; i -= 16) {
+        unsigned mask = terminatorMask(p + i - 16);
+        if (mask) return i - 16 + highestBit(mask);
+    }
+#endif
+    while (i-- > 0) {
+        if (isSentenceEnd(p[i])) return i;
+    }
+    return n;
+}
+
+// End of the sentence whose terminator sits at p[k]: a run of newlines
+// ("\n\n", "\r\n\r\n") stays together with the chunk it closes.
+inline size_t sentenceEndAfter(const char* p, size_t k, size_t limit) {
+    size_t end = k + 1;
+    if (p[k] == '\n') {
+        while (end < limit && (p[end] == '\n' || p[end] == '\r')) end++;
+    }
+    return end;
+}
+
+} // namespace chunk_detail
+
+// ===========================
+//  Split text into chunks
+// ===========================
+// Fixed-size chunks of up to maxChars, pulled back to the last sentence end
+// ('.', '!', '?' or a newline run) when one is available.
+inline std::vector<std::string_view> chunkViews(std::string_view text, size_t maxChars = 3000) {
+    using namespace chunk_detail;
+    std::vector<std::string_view> chunks;
+    maxChars = std::max<size_t>(maxChars, 1);
+    chunks.reserve(text.size() / maxChars + 1);
+    size_t pos = 0;
+
+    while (pos < text.length()) {
+        size_t chunkSize = std::min(maxChars, text.length() - pos);
+
+        // Try to break at sentence boundary
+        if (pos + chunkSize < text.length() && chunkSize > 1) {
+            const char* p = text.data() + pos;
+            size_t last = findLastTerminator(p + 1, chunkSize - 1);
+            if (last != chunkSize - 1) {
+                chunkSize = sentenceEndAfter(p, last + 1, chunkSize);
+            }
+        }
+
+        chunks.push_back(text.substr(pos, chunkSize));
+        pos += chunkSize;
+    }
+
+    return chunks;
+}
+
+// ===========================
+//  Content-defined chunking
+// ===========================
+// FastCDC-style: a gear rolling hash picks cut candidates from the content
+// itself, so an edit only moves the boundaries next to it and the chunks
+// after it come out byte-identical (and hit the cache). Candidates are
+// snapped forward to the next sentence end so no clause is split.
+//
+// Chunk sizes stay within [minChars, maxChars] except for the last chunk;
+// the rolling hash is normalized so most chunks land near avgChars.
+namespace cdc_detail {
+
+inline const uint64_t* gearTable() {
+    static const std::vector<uint64_t> table = [] {
+        std::vector<uint64_t> t(256);
+        uint64_t x = 0x9e3779b97f4a7c15ull; // splitmix64, fixed seed
+        for (auto& v : t) {
+            uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            v = z ^ (z >> 31);
+        }
+        return t;
+    }();
+    return table.data();
+}
+
+} // namespace cdc_detail
+
+// Offset one past the end of the chunk starting at `pos`.
+inline size_t cdcCut(std::string_view text, size_t pos, size_t minChars, size_t avgChars, size_t maxChars) {
+    using namespace chunk_detail;
+    size_t n = text.size() - pos;
+    if (n <= minChars) return text.size();
+    size_t limit = std::min(n, maxChars);
+    size_t normal = std::min(limit, avgChars);
+
+    // Top bits of the gear hash depend on the last 64 bytes; a stricter mask
+    // before avgChars and a looser one after pulls sizes toward the average.
+    int bits = 0;
+    while ((size_t(1) << (bits + 1)) <= avgChars) bits++;
+    int strict = std::min(bits + 1, 63), loose = std::max(bits - 1, 1);
+
+    const uint64_t* gear = cdc_detail::gearTable();
+    const char* c = text.data() + pos;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(c);
+    uint64_t h = 0;
+    size_t cut = limit;
+    size_t i = minChars;
+    for (; i < normal; i++) {
+        h = (h << 1) + gear[p[i]];
+        if ((h >> (64 - strict)) == 0) break;
+    }
+    if (i == normal) {
+        for (; i < limit; i++) {
+            h = (h << 1) + gear[p[i]];
+            if ((h >> (64 - loose)) == 0) break;
+        }
+    }
+    if (i < limit) cut = i + 1;
+
+    // Snap forward to the next sentence end; if there is none before
+    // maxChars, fall back to the last one after minChars.
+    size_t next = cut - 1 + findTerminator(c + cut - 1, limit - (cut - 1));
+    if (next < limit) return pos + sentenceEndAfter(c, next, limit);
+    if (limit == n) return text.size();
+    size_t last = findLastTerminator(c + minChars, limit - minChars);
+    if (last != limit - minChars) return pos + sentenceEndAfter(c, minChars + last, limit);
+    return pos + limit;
+}
+
+inline std::vector<std::string_view> chunkViewsCDC(std::string_view text, size_t minChars = 1000,
+                                                   size_t avgChars = 2500, size_t maxChars = 4000) {
+    std::vector<std::string_view> chunks;
+    // All three end up in [1, maxChars] with min <= avg, so zeros are safe
+    maxChars = std::max<size_t>(maxChars, 1);
+    minChars = std::min(std::max<size_t>(minChars, 1), maxChars);
+    avgChars = std::min(std::max(avgChars, minChars), maxChars);
+    chunks.reserve(text.size() / avgChars + 1);
+
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = cdcCut(text, pos, minChars, avgChars, maxChars);
+        chunks.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+    return chunks;
+}
+
+// ===========================
+//  Token-budget packing
+// ===========================
+// Packs whole sentences into each chunk until the next one would push the
+// estimated token count past tokenBudget. A single sentence longer than the
+// budget is walked once, piece by piece, and cut before the piece that would
+// overflow; one piece longer than the budget is cut into equal byte slices.
+inline std::vector<std::string_view> chunkViewsByTokens(std::string_view text, size_t tokenBudget = 1500) {
+    using namespace chunk_detail;
+    std::vector<std::string_view> chunks;
+    tokenBudget = std::max<size_t>(tokenBudget, 1);
+    const char* p = text.data();
+    size_t n = text.size();
+
+    size_t start = 0, pos = 0, tokens = 0;
+    while (pos < n) {
+        size_t k = pos + findTerminator(p + pos, n - pos);
+        size_t end = k < n ? sentenceEndAfter(p, k, n) : n;
+        size_t t = estimateTokens(text.substr(pos, end - pos));
+
+        if (tokens + t > tokenBudget && pos > start) {
+            chunks.push_back(text.substr(start, pos - start));
+            start = pos;
+            tokens = 0;
+        }
+
+        // Oversized sentence (start == pos here): t becomes the estimate of
+        // its last slice
+        if (t > tokenBudget) {
+            const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+            t = 0;
+            size_t i = pos;
+            while (i < end) {
+                size_t piece = i;
+                size_t pt = token_detail::nextPiece(u, end, i);
+                if (t + pt <= tokenBudget) {
+                    t += pt;
+                    continue;
+                }
+                if (piece > start) {
+                    // Keep a leading space on the slice it follows
+                    size_t cut = u[piece] == ' ' ? piece + 1 : piece;
+                    chunks.push_back(text.substr(start, cut - start));
+                    start = i = cut;
+                    t = 0;
+                    continue;
+                }
+                size_t step = std::max<size_t>((i - piece) * tokenBudget / pt, 1);
+                while (i - start > step) {
+                    size_t cut = start + step;
+                    while (cut > start + 1 && (u[cut] & 0xc0) == 0x80) cut--;
+                    chunks.push_back(text.substr(start, cut - start));
+                    start = cut;
+                }
+                t = estimateTokens(text.substr(start, i - start));
+            }
+        }
+
+        tokens += t;
+        pos = end;
+    }
+    if (start < n) chunks.push_back(text.substr(start));
+    return chunks;
+}
+
+// ===========================
+//  Owning variants
+// ===========================
+// For callers that need the chunks to outlive the source text.
+inline std::vector<std::string> chunkText(const std::string& text, size_t maxChars = 3000) {
+    std::vector<std::string> out;
+    for (auto v : chunkViews(text, maxChars)) out.emplace_back(v);
+    return out;
+}
+
+inline std::vector<std::string> chunkTextCDC(const std::string& text, size_t minChars = 1000,
+                                             size_t avgChars = 2500, size_t maxChars = 4000) {
+    std::vector<std::string> out;
+    for (auto v : chunkViewsCDC(text, minChars, avgChars, maxChars)) out.emplace_back(v);
+    return out;
+}
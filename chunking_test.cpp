@@ -0,0 +1,82 @@
+#include "chunking.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdio>
+
+using namespace std;
+
+// ===========================
+//  Chunker checks
+// ===========================
+// Runs the three chunkers over edge-case texts with zero and inverted size
+// parameters (what TOS_CDC_* / TOS_CHUNK_TOKENS can be set to) and checks
+// that each call returns, that no chunk is empty, that the chunks put back
+// together are the input, and that no chunk is over its size bound.
+//
+//   ./chunking_test     (exit status 1 on any failure)
+
+int gFailures = 0;
+
+void expect(bool ok, const string& what) {
+    if (ok) return;
+    gFailures++;
+    printf("FAIL %s\n", what.c_str());
+}
+
+void checkChunks(const string& name, string_view text, const vector<string_view>& chunks, size_t maxChars) {
+    string joined;
+    for (auto c : chunks) {
+        expect(!c.empty(), name + ": empty chunk");
+        expect(c.size() <= maxChars, name + ": chunk of " + to_string(c.size()) + " chars over " + to_string(maxChars));
+        joined.append(c);
+    }
+    expect(joined == text, name + ": chunks do not add up to the input");
+}
+
+int main() {
+    const vector<string> texts = {
+        "",
+        "a",
+        ".",
+        string(100, 'a'),
+        string(100, '.'),
+        "One. Two! Three? Four.\n\nFive six seven. " + string(300, 'x') + " end.",
+    };
+
+    struct Bounds {
+        size_t minChars, avgChars, maxChars;
+    };
+    const vector<Bounds> cdcBounds = {
+        {0, 0, 0}, {0, 0, 50}, {0, 0, 1}, {1, 1, 1}, {0, 10, 5}, {50, 0, 10}, {10, 5, 20}, {1000, 2500, 4000},
+    };
+
+    for (size_t t = 0; t < texts.size(); t++) {
+        const string& text = texts[t];
+        string label = "text " + to_string(t);
+
+        for (size_t maxChars : {size_t(0), size_t(1), size_t(7), size_t(3000)}) {
+            string name = label + " chunkViews(" + to_string(maxChars) + ")";
+            checkChunks(name, text, chunkViews(text, maxChars), max<size_t>(maxChars, 1));
+        }
+
+        for (const Bounds& b : cdcBounds) {
+            string name = label + " chunkViewsCDC(" + to_string(b.minChars) + ", " + to_string(b.avgChars) + ", " +
+                          to_string(b.maxChars) + ")";
+            checkChunks(name, text, chunkViewsCDC(text, b.minChars, b.avgChars, b.maxChars), max<size_t>(b.maxChars, 1));
+        }
+
+        for (size_t budget : {size_t(0), size_t(1), size_t(3), size_t(1500)}) {
+            string name = label + " chunkViewsByTokens(" + to_string(budget) + ")";
+            checkChunks(name, text, chunkViewsByTokens(text, budget), text.size());
+        }
+    }
+
+    if (gFailures) {
+        printf("%d checks failed\n", gFailures);
+        return 1;
+    }
+    printf("all chunker checks passed\n");
+    return 0;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// ===========================
+//  Upstream circuit breaker
+// ===========================
+// Closed: calls go through and their outcomes fill a window of the last
+// `window` calls. Once it holds at least `minCalls` and the share of failed
+// or slow calls reaches the threshold, the breaker opens.
+// Open: calls are refused without touching the network for `openFor`.
+// Half-open: up to `probes` calls go through to test the upstream; if they
+// all succeed the breaker closes with a fresh window, any failure reopens it.
+class CircuitBreaker {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class State { Closed, Open, HalfOpen };
+
+    struct Options {
+        size_t window = 50;
+        size_t minCalls = 10;
+        double failureRatio = 0.5;    // failed or slow share that trips it
+        Clock::duration slowCall{};   // calls at least this long count as failed; 0 = never
+        Clock::duration openFor = std::chrono::seconds(10);
+        size_t probes = 3;
+    };
+
+    struct Stats {
+        State state;
+        uint64_t trips, rejected;
+        size_t recentCalls, recentFailures;
+    };
+
+    explicit CircuitBreaker(Options options) : options_(options), outcomes_(std::max<size_t>(options.window, 1)) {}
+
+    // Whether a call may go now. Every allowed call must be followed by
+    // exactly one record().
+    bool allow() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (state_ == State::Open) {
+            if (Clock::now() < openUntil_) {
+                rejected_++;
+                return false;
+            }
+            state_ = State::HalfOpen;
+            probesStarted_ = probesPassed_ = 0;
+        }
+        if (state_ == State::HalfOpen) {
+            if (probesStarted_ >= options_.probes) {
+                rejected_++;
+                return false;
+            }
+            probesStarted_++;
+        }
+        return true;
+    }
+
+    void record(bool ok, Clock::duration latency) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        bool failed = !ok || (options_.slowCall.count() > 0 && latency >= options_.slowCall);
+        switch (state_) {
+        case State::HalfOpen:
+            if (failed) {
+                trip();
+            } else if (++probesPassed_ >= options_.probes) {
+                state_ = State::Closed;
+                clearWindow();
+            }
+            break;
+        case State::Closed:
+            push(failed);
+            if (count_ >= options_.minCalls && failures_ >= options_.failureRatio * count_) trip();
+            break;
+        case State::Open:
+            // Let through before the breaker opened; already counted
+            break;
+        }
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        State state = state_;
+        if (state == State::Open && Clock::now() >= openUntil_) state = State::HalfOpen;
+        return Stats{state, trips_, rejected_, count_, failures_};
+    }
+
+    static const char* name(State state) {
+        switch (state) {
+        case State::Closed: return "closed";
+        case State::Open: return "open";
+        case State::HalfOpen: return "half-open";
+        }
+        return "";
+    }
+
+private:
+    void push(bool failed) {
+        if (count_ == outcomes_.size()) {
+            failures_ -= outcomes_[next_];
+        } else {
+            count_++;
+        }
+        outcomes_[next_] = failed;
+        failures_ += failed;
+        next_ = (next_ + 1) % outcomes_.size();
+    }
+
+    void clearWindow() {
+        std::fill(outcomes_.begin(), outcomes_.end(), 0);
+        count_ = failures_ = next_ = 0;
+    }
+
+    void trip() {
+        state_ = State::Open;
+        openUntil_ = Clock::now() + options_.openFor;
+        trips_++;
+        clearWindow();
+    }
+
+    const Options options_;
+    std::mutex mutex_;
+    State state_ = State::Closed;
+    std::vector<uint8_t> outcomes_; // ring of the last calls, 1 = failed
+    size_t count_ = 0, failures_ = 0, next_ = 0;
+    Clock::time_point openUntil_{};
+    size_t probesStarted_ = 0, probesPassed_ = 0;
+    uint64_t trips_ = 0, rejected_ = 0;
+};
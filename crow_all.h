@@ -8986,6 +8986,20 @@ namespace crow
         bool skip_body = false;            ///< Whether this is a response to a HEAD request.
         bool manual_length_header = false; ///< Whether Crow should automatically add a "Content-Length" header.
 
+        /// Produces the body incrementally instead of `body` (e.g. Server-Sent Events).
+
+        ///
+        /// The headers are sent first, then every string passed to the writer goes out as one
+        /// HTTP/1.1 chunk. The writer returns false once the client has gone away.
+        std::function<void(const std::function<bool(const std::string&)>&)> body_stream;
+
+        /// Runs body_stream somewhere other than the connection's I/O thread (e.g. a worker pool).
+
+        ///
+        /// When set, the producer is handed to it and every chunk is written from the I/O thread,
+        /// so end() must also be called on that thread. When unset, the producer runs inline.
+        std::function<void(std::function<void()>)> body_stream_executor;
+
         /// Set the value of an existing header in the response.
         void set_header(std::string key, std::string value)
         {
@@ -9109,6 +9123,8 @@ namespace crow
             headers = std::move(r.headers);
             completed_ = r.completed_;
             file_info = std::move(r.file_info);
+            body_stream = std::move(r.body_stream);
+            body_stream_executor = std::move(r.body_stream_executor);
             return *this;
         }
 
@@ -9125,6 +9141,8 @@ namespace crow
             headers.clear();
             completed_ = false;
             file_info = static_file_info{};
+            body_stream = nullptr;
+            body_stream_executor = nullptr;
         }
 
         /// Return a "Temporary Redirect" response.
@@ -9186,7 +9204,11 @@ namespace crow
                 }
                 if (complete_request_handler_)
                 {
-                    complete_request_handler_();
+                    // The handler may hold the last reference to the connection
+                    // that owns this response; keep it alive until it returns.
+                    auto handler = std::move(complete_request_handler_);
+                    complete_request_handler_ = nullptr;
+                    handler();
                     manual_length_header = false;
                     skip_body = false;
                 }
@@ -10667,6 +10689,7 @@ namespace crow
 #include <algorithm>
 #include <atomic>
 #include <chrono>
+#include <future>
 #include <memory>
 #include <vector>
 
@@ -10902,6 +10925,12 @@ namespace crow
             }
 #endif
 
+            if (res.body_stream)
+            {
+                do_write_stream();
+                return;
+            }
+
             prepare_buffers();
 
             if (res.is_static_type())
@@ -10959,6 +10988,112 @@ namespace crow
             parser_.clear();
         }
 
+        /// Send the headers, then each part produced by res.body_stream as a chunk of a chunked body.
+        void do_write_stream()
+        {
+            auto producer = std::move(res.body_stream);
+            auto executor = std::move(res.body_stream_executor);
+            res.body_stream = nullptr;
+            res.body_stream_executor = nullptr;
+            res.set_header("Transfer-Encoding", "chunked");
+            res.manual_length_header = true;
+            prepare_buffers();
+            cancel_deadline_timer();
+
+            error_code ec;
+            asio::write(adaptor_.socket(), buffers_, ec);
+            bool open = !ec;
+
+            if (!executor)
+            {
+                producer([this, &open](const std::string& part) {
+                    if (open && !part.empty())
+                    {
+                        std::string size = chunk_size_line(part);
+                        std::vector<asio::const_buffer> chunk{asio::buffer(size), asio::buffer(part), asio::buffer(crlf)};
+                        error_code write_ec;
+                        asio::write(adaptor_.socket(), chunk, write_ec);
+                        open = !write_ec;
+                    }
+                    return open;
+                });
+                finish_stream(open);
+                return;
+            }
+
+            // The producer runs on the executor's thread; each chunk is written by an async_write
+            // started on the I/O thread (the socket and the shared deadline timer are only touched
+            // there) while the producer waits for it. The trailer and the return to reading are
+            // posted back the same way.
+            auto self = this->shared_from_this();
+            executor([self, producer = std::move(producer), open]() mutable {
+                asio::io_context& io = self->adaptor_.get_io_context();
+                auto write = [&self, &io, &open](const std::string& part) {
+                    if (open && !part.empty())
+                    {
+                        std::string size = chunk_size_line(part);
+                        std::vector<asio::const_buffer> chunk{asio::buffer(size), asio::buffer(part), asio::buffer(crlf)};
+                        std::promise<bool> written;
+                        asio::post(io, [&self, &chunk, &written] {
+                            asio::async_write(self->adaptor_.socket(), chunk, [&written](const error_code& write_ec, std::size_t) {
+                                written.set_value(!write_ec);
+                            });
+                        });
+                        open = written.get_future().get();
+                    }
+                    return open;
+                };
+                try
+                {
+                    producer(write);
+                }
+                catch (const std::exception& e)
+                {
+                    // Nobody else would see it; cut the stream short instead
+                    CROW_LOG_ERROR << "body_stream producer threw: " << e.what();
+                    open = false;
+                }
+                asio::post(io, [self, open] {
+                    self->finish_stream(open);
+                });
+            });
+        }
+
+        static std::string chunk_size_line(const std::string& part)
+        {
+            std::ostringstream size_line;
+            size_line << std::hex << part.size() << "\r\n";
+            return size_line.str();
+        }
+
+        /// Terminate the chunked body and go back to reading (or close). Runs on the I/O thread.
+        void finish_stream(bool open)
+        {
+            error_code ec;
+            if (open)
+            {
+                asio::write(adaptor_.socket(), asio::buffer("0\r\n\r\n", 5), ec);
+            }
+            if (!open || ec || close_connection_)
+            {
+                adaptor_.shutdown_readwrite();
+                adaptor_.close();
+                CROW_LOG_DEBUG << this << " from write (body_stream)";
+            }
+
+            res.end();
+            res.clear();
+            buffers_.clear();
+            parser_.clear();
+
+            if (need_to_start_read_after_complete_)
+            {
+                need_to_start_read_after_complete_ = false;
+                start_deadline();
+                do_read();
+            }
+        }
+
         void do_write_general()
         {
             if (res.body.length() < res_stream_threshold_)
@@ -12241,7 +12376,8 @@ namespace crow // NOTE: Already documented in "crow/app.h"
             /// Also destroys the object if the Close flag is set.
             void do_write()
             {
-                if (write_buffers_.empty()) return;
+                // A write is still in flight; its completion handler picks up write_buffers_.
+                if (write_buffers_.empty() || !sending_buffers_.empty()) return;
 
                 sending_buffers_.swap(write_buffers_);
                 std::vector<asio::const_buffer> buffers;
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "upstream_client.h"
+#include "worker_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// ===========================
+//  Hedged upstream calls
+// ===========================
+// A call still running past a high percentile of recent latency is usually
+// stuck behind a slow upstream replica, not doing more work. Sending the same
+// request a second time then and taking whichever answer arrives first cuts
+// the tail; the slower one is cancelled. A budget caps how many extra
+// requests that may cost.
+namespace hedge_detail {
+
+using Clock = std::chrono::steady_clock;
+
+// Recent call latencies in a fixed ring; percentile() sorts a copy, which is
+// cheap at this size next to a network round trip.
+class LatencyWindow {
+public:
+    static constexpr size_t kSize = 256;
+    static constexpr size_t kMinSamples = 20;
+
+    void add(Clock::duration latency) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        samples_[next_++ % kSize] = latency;
+    }
+
+    // False until the window has enough samples to trust.
+    bool percentile(double pct, Clock::duration& out) {
+        std::vector<Clock::duration> sorted;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            size_t n = std::min<uint64_t>(next_, kSize);
+            if (n < kMinSamples) return false;
+            sorted.assign(samples_.begin(), samples_.begin() + n);
+        }
+        size_t rank = std::min(sorted.size() - 1, static_cast<size_t>(pct / 100 * sorted.size()));
+        std::nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+        out = sorted[rank];
+        return true;
+    }
+
+private:
+    std::mutex mutex_;
+    std::array<Clock::duration, kSize> samples_{};
+    uint64_t next_ = 0;
+};
+
+// One in-flight request and its possible duplicate.
+struct Race {
+    std::mutex mutex;
+    std::condition_variable cv;
+    HttpResponse results[2];
+    bool finished[2] = {false, false};
+    std::atomic<bool> cancel[2] = {{false}, {false}};
+    int launched = 1;
+};
+
+// Worth returning as it is, rather than waiting for the other request
+inline bool usable(const HttpResponse& res) {
+    return res.status >= 200 && res.status < 500 && res.status != 429;
+}
+
+} // namespace hedge_detail
+
+class HedgedCaller {
+public:
+    struct Stats {
+        uint64_t calls, hedges, hedgeWins, skippedBudget;
+        double delayMs; // current hedge delay, 0 while still learning
+    };
+
+    // percentile: latency rank after which a duplicate goes out (0 = never).
+    // maxExtraPercent: duplicates allowed per 100 calls, with a small burst.
+    HedgedCaller(double percentile, double maxExtraPercent, size_t threads)
+        : percentile_(percentile), creditPerCall_(maxExtraPercent / 100), pool_(threads) {}
+
+    bool enabled() const { return percentile_ > 0; }
+
+    // call(cancel) performs one request and must own everything it touches,
+    // since a cancelled one may finish after this returns. mayHedge() is asked
+    // before a duplicate goes out and can veto it (e.g. the rate limiter).
+    template <typename Call, typename MayHedge>
+    HttpResponse run(Call call, MayHedge&& mayHedge) {
+        using namespace hedge_detail;
+        calls_.fetch_add(1, std::memory_order_relaxed);
+        earnCredit();
+
+        Clock::duration delay;
+        if (!enabled() || !window_.percentile(percentile_, delay)) {
+            Clock::time_point start = Clock::now();
+            HttpResponse res = call(nullptr);
+            if (usable(res)) window_.add(Clock::now() - start);
+            return res;
+        }
+        delayNs_.store(std::chrono::duration_cast<std::chrono::nanoseconds>(delay).count(),
+                       std::memory_order_relaxed);
+
+        auto race = std::make_shared<Race>();
+        Clock::time_point start = Clock::now();
+        auto launch = [&](int i) {
+            pool_.submit([race, call, i] {
+                HttpResponse res = call(&race->cancel[i]);
+                std::lock_guard<std::mutex> lock(race->mutex);
+                race->results[i] = std::move(res);
+                race->finished[i] = true;
+                race->cv.notify_all();
+            });
+        };
+        launch(0);
+
+        std::unique_lock<std::mutex> lock(race->mutex);
+        if (!race->cv.wait_for(lock, delay, [&] { return race->finished[0]; })) {
+            lock.unlock();
+            bool hedge = false;
+            if (!takeCredit()) {
+                skippedBudget_.fetch_add(1, std::memory_order_relaxed);
+            } else if (mayHedge()) {
+                hedge = true;
+            } else {
+                refundCredit();
+            }
+            lock.lock();
+            if (hedge && !race->finished[0]) {
+                race->launched = 2;
+                hedges_.fetch_add(1, std::memory_order_relaxed);
+                lock.unlock();
+                launch(1);
+                lock.lock();
+            } else if (hedge) {
+                refundCredit();
+            }
+        }
+
+        // First usable answer wins; if neither is usable, either failure will do
+        int winner = -1;
+        race->cv.wait(lock, [&] {
+            bool all = true;
+            for (int i = 0; i < race->launched; i++) {
+                if (race->finished[i] && usable(race->results[i])) {
+                    winner = i;
+                    return true;
+                }
+                if (race->finished[i]) winner = i;
+                all = all && race->finished[i];
+            }
+            return all;
+        });
+        for (int i = 0; i < race->launched; i++) {
+            if (i != winner) race->cancel[i].store(true, std::memory_order_relaxed);
+        }
+        HttpResponse res = std::move(race->results[winner]);
+        lock.unlock();
+
+        if (usable(res)) {
+            window_.add(Clock::now() - start);
+            if (winner == 1) hedgeWins_.fetch_add(1, std::memory_order_relaxed);
+        }
+        return res;
+    }
+
+    Stats stats() const {
+        return Stats{calls_.load(std::memory_order_relaxed), hedges_.load(std::memory_order_relaxed),
+                     hedgeWins_.load(std::memory_order_relaxed), skippedBudget_.load(std::memory_order_relaxed),
+                     delayNs_.load(std::memory_order_relaxed) / 1e6};
+    }
+
+private:
+    // Each call earns creditPerCall_ of a duplicate, banked up to kMaxCredit,
+    // so over any stretch the extra requests stay near the configured share.
+    static constexpr double kMaxCredit = 5;
+
+    void earnCredit() {
+        std::lock_guard<std::mutex> lock(creditMutex_);
+        credit_ = std::min(kMaxCredit, credit_ + creditPerCall_);
+    }
+
+    bool takeCredit() {
+        std::lock_guard<std::mutex> lock(creditMutex_);
+        if (credit_ < 1) return false;
+        credit_ -= 1;
+        return true;
+    }
+
+    void refundCredit() {
+        std::lock_guard<std::mutex> lock(creditMutex_);
+        credit_ = std::min(kMaxCredit, credit_ + 1);
+    }
+
+    const double percentile_;
+    const double creditPerCall_;
+    hedge_detail::LatencyWindow window_;
+    std::mutex creditMutex_;
+    double credit_ = 0;
+    std::atomic<uint64_t> calls_{0}, hedges_{0}, hedgeWins_{0}, skippedBudget_{0};
+    std::atomic<int64_t> delayNs_{0};
+    WorkerPool pool_;
+};
@@ -0,0 +1,189 @@
+#pragma once
+
+#include "analysis_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// ===========================
+//  Merge near-duplicate highlights
+// ===========================
+// Chunks are analyzed independently, so one clause often comes back from
+// several of them in slightly different words. Highlights are compared as
+// sets of word pairs: identical normalized text merges directly, MinHash
+// signatures bucketed by LSH bands propose fuzzy candidates without comparing
+// every pair, and the exact Jaccard similarity of the two sets decides. A
+// merged group keeps the most complete wording, at the position where the
+// group first appeared.
+namespace dedup_detail {
+
+const size_t kHashes = 24;
+const size_t kBands = 12;
+const size_t kRows = kHashes / kBands;
+// Bucket entries checked per band; bounds the work on degenerate input
+const size_t kMaxBucketCompares = 16;
+
+// Hashes of the lowercased words, punctuation dropped. `word` is scratch
+// space kept across calls.
+template <typename String>
+void wordHashes(std::string_view text, String& word, std::pmr::vector<uint64_t>& out) {
+    out.clear();
+    word.clear();
+    auto flush = [&] {
+        if (word.empty()) return;
+        out.push_back(hashBytes(word.data(), word.size(), 0xd3d0));
+        word.clear();
+    };
+    for (unsigned char c : text) {
+        if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c >= 0x80) {
+            word.push_back(static_cast<char>(c));
+        } else if (c >= 'A' && c <= 'Z') {
+            word.push_back(static_cast<char>(c - 'A' + 'a'));
+        } else {
+            flush();
+        }
+    }
+    flush();
+}
+
+struct Signature {
+    uint64_t exact = 0;
+    uint64_t mins[kHashes];
+    size_t begin = 0, end = 0; // sorted, unique shingles: [begin, end) of the shared pool
+    size_t wordCount = 0;
+};
+
+// Appends the highlight's shingles to `pool`; `hashes` and `word` are scratch.
+template <typename String>
+Signature sign(std::string_view text, String& word, std::pmr::vector<uint64_t>& hashes,
+               std::pmr::vector<uint64_t>& pool) {
+    Signature sig;
+    wordHashes(text, word, hashes);
+    sig.wordCount = hashes.size();
+    std::fill(std::begin(sig.mins), std::end(sig.mins), ~uint64_t(0));
+
+    uint64_t exact = 0x5eed;
+    for (uint64_t h : hashes) exact = hashMix(exact ^ h, 0x9e3779b97f4a7c15ull);
+    sig.exact = exact;
+
+    // Shingles are adjacent word pairs (a lone word stands for itself)
+    sig.begin = pool.size();
+    if (hashes.size() == 1) pool.push_back(hashes[0]);
+    for (size_t i = 0; i + 1 < hashes.size(); i++) {
+        pool.push_back(hashMix(hashes[i], hashes[i + 1] ^ 0x8ebc6af09c88c6e3ull));
+    }
+    std::sort(pool.begin() + sig.begin, pool.end());
+    pool.erase(std::unique(pool.begin() + sig.begin, pool.end()), pool.end());
+    sig.end = pool.size();
+
+    for (size_t i = sig.begin; i < sig.end; i++) {
+        for (size_t k = 0; k < kHashes; k++) {
+            uint64_t h = hashMix(pool[i] ^ (0xa0761d6478bd642full * (k + 1)), 0xe7037ed1a0b428dbull);
+            sig.mins[k] = std::min(sig.mins[k], h);
+        }
+    }
+    return sig;
+}
+
+// Exact Jaccard similarity of the two shingle sets
+inline double similarity(const Signature& a, const Signature& b, const std::pmr::vector<uint64_t>& pool) {
+    size_t i = a.begin, j = b.begin, common = 0;
+    while (i < a.end && j < b.end) {
+        if (pool[i] < pool[j]) {
+            i++;
+        } else if (pool[j] < pool[i]) {
+            j++;
+        } else {
+            common++;
+            i++;
+            j++;
+        }
+    }
+    size_t all = (a.end - a.begin) + (b.end - b.begin) - common;
+    return all ? double(common) / all : 1.0;
+}
+
+inline size_t findRoot(std::pmr::vector<size_t>& parent, size_t i) {
+    while (parent[i] != i) i = parent[i] = parent[parent[i]];
+    return i;
+}
+
+} // namespace dedup_detail
+
+// minSimilarity is the Jaccard similarity of word pairs at which two
+// highlights count as the same clause; at 1.0 or above only normalized-equal
+// text merges. Returns how many highlights were merged away. `highlights`
+// holds strings or string_views; the working set is allocated from `memory`
+// (a RequestArena's, when there is one).
+template <typename Highlights>
+size_t dedupHighlights(Highlights& highlights, double minSimilarity = 0.5,
+                       std::pmr::memory_resource* memory = std::pmr::get_default_resource()) {
+    using namespace dedup_detail;
+    size_t n = highlights.size();
+    if (n < 2) return 0;
+
+    std::pmr::vector<Signature> sigs(memory);
+    sigs.reserve(n);
+    std::pmr::vector<uint64_t> pool(memory), hashes(memory);
+    std::pmr::string word(memory);
+    std::pmr::vector<size_t> parent(n, memory);
+    std::iota(parent.begin(), parent.end(), 0);
+    auto unite = [&](size_t a, size_t b) {
+        a = findRoot(parent, a);
+        b = findRoot(parent, b);
+        if (a != b) parent[std::max(a, b)] = std::min(a, b);
+    };
+
+    std::pmr::unordered_map<uint64_t, size_t> exact(memory);
+    std::pmr::vector<std::pmr::unordered_map<uint64_t, std::pmr::vector<size_t>>> bands(memory);
+    bands.resize(minSimilarity < 1.0 ? kBands : 0);
+    for (size_t i = 0; i < n; i++) {
+        sigs.push_back(sign(std::string_view(highlights[i]), word, hashes, pool));
+        auto hit = exact.emplace(sigs[i].exact, i);
+        if (!hit.second) {
+            unite(hit.first->second, i);
+            continue;
+        }
+        for (size_t b = 0; b < bands.size(); b++) {
+            uint64_t key = b;
+            for (size_t r = 0; r < kRows; r++) key = hashMix(key ^ sigs[i].mins[b * kRows + r], 0x9e3779b97f4a7c15ull);
+            auto& bucket = bands[b][key];
+            for (size_t j = 0; j < bucket.size() && j < kMaxBucketCompares; j++) {
+                if (findRoot(parent, bucket[j]) == findRoot(parent, i)) continue;
+                if (similarity(sigs[i], sigs[bucket[j]], pool) >= minSimilarity) unite(bucket[j], i);
+            }
+            bucket.push_back(i);
+        }
+    }
+
+    // Best wording per group: the most words, up to a point where it stops
+    // being a clause and starts being a paragraph
+    auto quality = [&](size_t i) { return std::min<size_t>(sigs[i].wordCount, 60); };
+    std::pmr::vector<size_t> best(n, memory);
+    for (size_t i = 0; i < n; i++) {
+        size_t root = findRoot(parent, i);
+        if (root == i) {
+            best[i] = i;
+        } else if (quality(i) > quality(best[root])) {
+            best[root] = i;
+        }
+    }
+
+    // Survivors move forward in place; best[i] >= i for every root, so no
+    // survivor is overwritten before it moves
+    size_t kept = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (findRoot(parent, i) == i) {
+            if (kept != best[i]) highlights[kept] = std::move(highlights[best[i]]);
+            kept++;
+        }
+    }
+    highlights.erase(highlights.begin() + kept, highlights.end());
+    return n - kept;
+}
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "crow_all.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ===========================
+//  Background analysis jobs
+// ===========================
+// Tracks analyses submitted through POST /jobs: their state, chunk progress
+// and final result. Finished jobs are dropped `ttl` after they complete.
+//
+// wait() is the long-poll hook: the callback fires exactly once, either when
+// the job finishes or with the current state when the deadline passes. It runs
+// on the thread that finished the job or on the store's timer thread, never
+// on the caller's, so no request thread is held while waiting.
+class JobStore {
+public:
+    enum class State { Queued, Running, Done, Failed };
+
+    struct Snapshot {
+        std::string id;
+        State state = State::Queued;
+        size_t chunksDone = 0;
+        size_t totalChunks = 0;
+        std::string error;
+        crow::json::wvalue result;
+
+        bool finished() const { return state == State::Done || state == State::Failed; }
+
+        crow::json::wvalue toJson() const {
+            static const char* names[] = {"queued", "running", "done", "failed"};
+            crow::json::wvalue out;
+            out["id"] = id;
+            out["status"] = names[static_cast<int>(state)];
+            out["chunksDone"] = chunksDone;
+            out["totalChunks"] = totalChunks;
+            if (state == State::Done) out["result"] = crow::json::wvalue(result);
+            if (state == State::Failed) out["error"] = error;
+            return out;
+        }
+    };
+
+    using Waiter = std::function<void(const Snapshot&)>;
+    using Clock = std::chrono::steady_clock;
+
+    explicit JobStore(std::chrono::seconds ttl): ttl_(ttl), timer_([this] { runTimer(); }) {}
+
+    ~JobStore() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        cv_.notify_all();
+        timer_.join();
+    }
+
+    JobStore(const JobStore&) = delete;
+    JobStore& operator=(const JobStore&) = delete;
+
+    std::string create() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string id;
+        do {
+            char buf[17];
+            std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(rng_()));
+            id = buf;
+        } while (jobs_.count(id));
+        jobs_[id].snap.id = id;
+        return id;
+    }
+
+    void start(const std::string& id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(id);
+        if (it != jobs_.end()) it->second.snap.state = State::Running;
+    }
+
+    void progress(const std::string& id, size_t done, size_t total) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return;
+        it->second.snap.chunksDone = done;
+        it->second.snap.totalChunks = total;
+    }
+
+    void finish(const std::string& id, crow::json::wvalue result) {
+        complete(id, [&](Snapshot& s) {
+            s.state = State::Done;
+            s.chunksDone = s.totalChunks;
+            s.result = std::move(result);
+        });
+    }
+
+    void fail(const std::string& id, const std::string& error) {
+        complete(id, [&](Snapshot& s) {
+            s.state = State::Failed;
+            s.error = error;
+        });
+    }
+
+    bool snapshot(const std::string& id, Snapshot& out) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = jobs_.find(id);
+        if (it == jobs_.end()) return false;
+        copyInto(it->second.snap, out);
+        return true;
+    }
+
+    // Returns false (and never calls `waiter`) if the job is unknown.
+    bool wait(const std::string& id, Clock::time_point deadline, Waiter waiter) {
+        Snapshot now;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = jobs_.find(id);
+            if (it == jobs_.end()) return false;
+            if (!it->second.snap.finished() && deadline > Clock::now()) {
+                it->second.waiters.push_back({deadline, std::move(waiter)});
+                cv_.notify_all();
+                return true;
+            }
+            copyInto(it->second.snap, now);
+        }
+        waiter(now);
+        return true;
+    }
+
+private:
+    struct PendingWait {
+        Clock::time_point deadline;
+        Waiter fn;
+    };
+
+    struct Job {
+        Snapshot snap;
+        std::vector<PendingWait> waiters;
+        Clock::time_point expires = Clock::time_point::max();
+    };
+
+    static void copyInto(const Snapshot& from, Snapshot& to) {
+        to.id = from.id;
+        to.state = from.state;
+        to.chunksDone = from.chunksDone;
+        to.totalChunks = from.totalChunks;
+        to.error = from.error;
+        if (from.state == State::Done) to.result = crow::json::wvalue(from.result);
+    }
+
+    template <typename Update>
+    void complete(const std::string& id, Update&& update) {
+        std::vector<PendingWait> waiters;
+        Snapshot done;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = jobs_.find(id);
+            if (it == jobs_.end()) return;
+            update(it->second.snap);
+            it->second.expires = Clock::now() + ttl_;
+            waiters.swap(it->second.waiters);
+            copyInto(it->second.snap, done);
+        }
+        cv_.notify_all();
+        for (auto& w : waiters) w.fn(done);
+    }
+
+    // Fires long-poll waiters whose deadline passed and drops expired jobs.
+    void runTimer() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stopping_) {
+            Clock::time_point now = Clock::now();
+            Clock::time_point next = now + std::chrono::seconds(1);
+            std::vector<std::pair<Waiter, Snapshot>> due;
+
+            for (auto it = jobs_.begin(); it != jobs_.end();) {
+                Job& job = it->second;
+                if (job.expires <= now) {
+                    it = jobs_.erase(it);
+                    continue;
+                }
+                for (size_t i = 0; i < job.waiters.size();) {
+                    if (job.waiters[i].deadline <= now) {
+                        due.emplace_back(std::move(job.waiters[i].fn), Snapshot());
+                        copyInto(job.snap, due.back().second);
+                        job.waiters.erase(job.waiters.begin() + i);
+                    } else {
+                        next = std::min(next, job.waiters[i].deadline);
+                        i++;
+                    }
+                }
+                ++it;
+            }
+
+            if (!due.empty()) {
+                lock.unlock();
+                for (auto& d : due) d.first(d.second);
+                lock.lock();
+                continue;
+            }
+            cv_.wait_until(lock, next);
+        }
+    }
+
+    std::chrono::seconds ttl_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::unordered_map<std::string, Job> jobs_;
+    std::mt19937_64 rng_{std::random_device{}()};
+    bool stopping_ = false;
+    std::thread timer_;
+};
@@ -0,0 +1,193 @@
+#define CROW_MAIN
+#define CROW_USE_BOOST
+#include "crow_all.h"
+#include "upstream_client.h"
+#include "worker_pool.h"
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+
+// ===========================
+//  /analyze load generator
+// ===========================
+// Sends POST /analyze at a fixed rate (open loop: a slow reply does not delay
+// the next send) and reports latency percentiles, throughput and how many
+// upstream calls the run cost. Latency counts from when a request was due, so
+// time spent queued behind --concurrency shows up instead of hiding.
+//
+//   ./loadgen --file tos.txt --rps 20 --duration 30 --mock http://127.0.0.1:9000
+struct Options {
+    string url = "http://127.0.0.1:8080";
+    string mock;          // mock upstream to read /stats from, if any
+    string file;
+    double rps = 10;
+    double duration = 30; // seconds
+    size_t concurrency = 64;
+    bool unique = false;  // make every document distinct, defeating the caches
+    string engine;
+};
+
+void usage() {
+    cout << "usage: loadgen --file PATH [--url http://127.0.0.1:8080] [--rps 10] [--duration 30]\n"
+            "               [--concurrency 64] [--mock http://127.0.0.1:9000] [--unique] [--engine offline]\n";
+}
+
+bool parseArgs(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto value = [&]() -> const char* { return i + 1 < argc ? argv[++i] : nullptr; };
+        const char* v = nullptr;
+        if (arg == "--unique") {
+            o.unique = true;
+            continue;
+        }
+        if (!(v = value())) return false;
+        if (arg == "--url") {
+            o.url = v;
+        } else if (arg == "--mock") {
+            o.mock = v;
+        } else if (arg == "--file") {
+            o.file = v;
+        } else if (arg == "--rps") {
+            o.rps = atof(v);
+        } else if (arg == "--duration") {
+            o.duration = atof(v);
+        } else if (arg == "--concurrency") {
+            o.concurrency = strtoul(v, nullptr, 10);
+        } else if (arg == "--engine") {
+            o.engine = v;
+        } else {
+            return false;
+        }
+    }
+    return !o.file.empty() && o.rps > 0 && o.duration > 0 && o.concurrency > 0;
+}
+
+// Reads one counter from a JSON stats endpoint: path "a.b" walks objects.
+bool readCounter(UpstreamClient& client, const string& endpoint, const vector<string>& path, double& out) {
+    HttpResponse res = client.get(endpoint);
+    if (res.status != 200) return false;
+    auto json = crow::json::load(res.body);
+    if (!json) return false;
+    const crow::json::rvalue* node = &json;
+    for (auto& key : path) {
+        if (node->t() != crow::json::type::Object || !node->has(key)) return false;
+        node = &(*node)[key];
+    }
+    if (node->t() != crow::json::type::Number) return false;
+    out = node->d();
+    return true;
+}
+
+// Upstream calls so far: the mock's own count when there is one, otherwise
+// the analyzer's attempts plus hedges.
+bool upstreamCalls(UpstreamClient& server, UpstreamClient* mock, double& out) {
+    if (mock) return readCounter(*mock, "/stats", {"requests"}, out);
+    double calls, hedges;
+    if (!readCounter(server, "/upstream/stats", {"hedging", "calls"}, calls) ||
+        !readCounter(server, "/upstream/stats", {"hedging", "hedges"}, hedges)) {
+        return false;
+    }
+    out = calls + hedges;
+    return true;
+}
+
+double percentile(const vector<double>& sorted, double pct) {
+    if (sorted.empty()) return 0;
+    size_t rank = min(sorted.size() - 1, static_cast<size_t>(pct / 100 * sorted.size()));
+    return sorted[rank];
+}
+
+int main(int argc, char** argv) {
+    Options opt;
+    if (!parseArgs(argc, argv, opt)) {
+        usage();
+        return 2;
+    }
+
+    ifstream file(opt.file, ios::binary);
+    if (!file.is_open()) {
+        cout << "Cannot read " << opt.file << "\n";
+        return 1;
+    }
+    stringstream text;
+    text << file.rdbuf();
+
+    UpstreamUrl serverUrl, mockUrl;
+    if (!UpstreamUrl::parse(opt.url, serverUrl) || (!opt.mock.empty() && !UpstreamUrl::parse(opt.mock, mockUrl))) {
+        cout << "Invalid URL\n";
+        return 2;
+    }
+    UpstreamClient server(serverUrl, opt.concurrency, chrono::minutes(5));
+    unique_ptr<UpstreamClient> mock;
+    if (!opt.mock.empty()) mock = make_unique<UpstreamClient>(mockUrl, 1, chrono::seconds(10));
+
+    double callsBefore = 0;
+    bool haveCalls = upstreamCalls(server, mock.get(), callsBefore);
+
+    size_t total = static_cast<size_t>(opt.rps * opt.duration);
+    cout << "Sending " << total << " requests at " << opt.rps << "/s to " << opt.url << "/analyze ("
+         << text.str().size() << " bytes each" << (opt.unique ? ", unique" : "") << ")...\n";
+
+    mutex m;
+    vector<double> latencies; // ms, successful requests only
+    latencies.reserve(total);
+    size_t failed = 0, degraded = 0;
+    vector<future<void>> pending;
+    pending.reserve(total);
+
+    WorkerPool pool(opt.concurrency);
+    auto start = chrono::steady_clock::now();
+    for (size_t i = 0; i < total; i++) {
+        auto due = start + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(i / opt.rps));
+        this_thread::sleep_until(due);
+
+        crow::json::wvalue body;
+        body["tosText"] = opt.unique ? text.str() + "\n\nRequest " + to_string(i) : text.str();
+        if (!opt.engine.empty()) body["engine"] = opt.engine;
+        auto payload = make_shared<string>(body.dump());
+
+        pending.push_back(pool.submit([&, due, payload] {
+            HttpResponse res = server.post("/analyze", {{"Content-Type", "application/json"}}, *payload);
+            double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - due).count();
+            auto json = res.status == 200 ? crow::json::load(res.body) : crow::json::rvalue();
+            lock_guard<mutex> lock(m);
+            if (!json || json.has("error")) {
+                failed++;
+                return;
+            }
+            latencies.push_back(ms);
+            if (json.has("degraded") && json["degraded"].b()) degraded++;
+        }));
+    }
+    for (auto& f : pending) f.get();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(latencies.begin(), latencies.end());
+    printf("requests:    %zu sent, %zu ok, %zu failed, %zu degraded\n", total, latencies.size(), failed, degraded);
+    printf("throughput:  %.2f req/s over %.1f s\n", latencies.size() / seconds, seconds);
+    printf("latency ms:  p50 %.1f  p95 %.1f  p99 %.1f  max %.1f\n", percentile(latencies, 50),
+           percentile(latencies, 95), percentile(latencies, 99), latencies.empty() ? 0.0 : latencies.back());
+
+    double callsAfter = 0;
+    if (haveCalls && upstreamCalls(server, mock.get(), callsAfter)) {
+        double calls = callsAfter - callsBefore;
+        printf("upstream:    %.0f calls (%.2f per request)%s\n", calls, total ? calls / total : 0.0,
+               mock ? "" : ", as counted by the analyzer");
+    } else {
+        printf("upstream:    call count unavailable\n");
+    }
+    return failed ? 1 : 0;
+}
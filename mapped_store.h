@@ -0,0 +1,425 @@
+#pragma once
+
+#include "analysis_cache.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace mapped_store_detail {
+
+const uint32_t kRecordMagic = 0x31524843;          // "CHR1"
+const uint64_t kIndexMagic = 0x31584449534f54ull;  // "TOSIDX1"
+const uint32_t kIndexVersion = 1;
+const uint64_t kMinCapacity = 1024;
+
+// Data file record: header, payload, zero padding to 8 bytes.
+// Payload is a u32 count followed by (u32 length, bytes) per highlight.
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t payloadLen;
+    uint64_t hi;
+    uint64_t lo;
+    uint64_t checksum;
+};
+
+struct IndexHeader {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t capacity; // slots, power of two
+    uint64_t count;    // advisory; only used to decide when to grow
+};
+
+// offset is the record offset + 1, so an all-zero slot is empty.
+struct Slot {
+    uint64_t hi;
+    uint64_t lo;
+    uint64_t offset;
+};
+
+inline size_t align8(size_t n) { return (n + 7) & ~size_t(7); }
+
+inline uint64_t recordChecksum(const char* payload, size_t len, uint64_t hi, uint64_t lo) {
+    return hashBytes(payload, len, hi ^ lo);
+}
+
+} // namespace mapped_store_detail
+
+// ===========================
+//  Persistent chunk store (mmap)
+// ===========================
+// chunk key -> highlights, kept in two files under one directory:
+//   chunks.dat  append-only records, mapped read-only for lookups
+//   chunks.idx  open-addressing hash table of (key, record offset), mapped
+//               read-write; opening it is a single mmap, no load step
+//
+// Crash safety: a record is fully written before any slot points at it, and a
+// slot's offset is stored last. Every lookup re-checks the record's magic, key,
+// bounds and checksum, so a torn write reads as a miss, never as bad data.
+// Growing the index writes a new file and renames it over the old one.
+//
+// POSIX only; on Windows builds open() fails and the store stays disabled.
+class MappedChunkStore {
+public:
+    struct Stats {
+        uint64_t hits, misses, entries, dataBytes, capacityBytes;
+    };
+
+    MappedChunkStore() = default;
+    ~MappedChunkStore() { close(); }
+
+    MappedChunkStore(const MappedChunkStore&) = delete;
+    MappedChunkStore& operator=(const MappedChunkStore&) = delete;
+
+    bool enabled() const { return data_ != nullptr; }
+
+    bool open(const std::string& dir, size_t maxDataBytes, std::string& error) {
+#ifdef _WIN32
+        (void)dir;
+        (void)maxDataBytes;
+        error = "memory-mapped cache is not supported on Windows builds";
+        return false;
+#else
+        std::error_code fsErr;
+        std::filesystem::create_directories(dir, fsErr);
+        if (fsErr) {
+            error = "cannot create " + dir + ": " + fsErr.message();
+            return false;
+        }
+        dataPath_ = dir + "/chunks.dat";
+        indexPath_ = dir + "/chunks.idx";
+
+        dataFd_ = ::open(dataPath_.c_str(), O_RDWR | O_CREAT, 0644);
+        if (dataFd_ < 0) {
+            error = "cannot open " + dataPath_ + ": " + std::strerror(errno);
+            return false;
+        }
+        struct stat st;
+        if (fstat(dataFd_, &st) != 0) {
+            error = "cannot stat " + dataPath_;
+            close();
+            return false;
+        }
+
+        // Map the whole budget up front; only offsets below dataEnd_ are
+        // ever touched, so the pages past EOF are never faulted in. A file
+        // written under a bigger budget is mapped whole, so every offset
+        // below dataEnd_ stays inside the mapping; such a store is full and
+        // takes no new records.
+        size_t dataEnd = mapped_store_detail::align8(static_cast<size_t>(st.st_size));
+        size_t mapBytes = std::max(maxDataBytes, dataEnd);
+        void* map = mmap(nullptr, mapBytes, PROT_READ, MAP_SHARED, dataFd_, 0);
+        if (map == MAP_FAILED) {
+            error = "cannot map " + dataPath_ + ": " + std::strerror(errno);
+            close();
+            return false;
+        }
+        data_ = static_cast<const char*>(map);
+        dataCapacity_ = mapBytes;
+        dataEnd_ = dataEnd;
+
+        if (!mapIndex() && !rebuildIndex()) {
+            error = "cannot build " + indexPath_;
+            close();
+            return false;
+        }
+        return true;
+#endif
+    }
+
+    bool get(const ChunkKey& key, std::vector<std::string>& out) {
+        if (!enabled()) return false;
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const mapped_store_detail::Slot* slot = find(key);
+        if (slot && decode(slot->offset - 1, key, out)) {
+            hits_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    bool put(const ChunkKey& key, const std::vector<std::string>& highlights) {
+#ifdef _WIN32
+        (void)key;
+        (void)highlights;
+        return false;
+#else
+        using namespace mapped_store_detail;
+        if (!enabled()) return false;
+
+        // Encode the record outside the lock
+        std::string record(sizeof(RecordHeader), '\0');
+        uint32_t count = static_cast<uint32_t>(highlights.size());
+        record.append(reinterpret_cast<const char*>(&count), 4);
+        for (auto& h : highlights) {
+            uint32_t len = static_cast<uint32_t>(h.size());
+            record.append(reinterpret_cast<const char*>(&len), 4);
+            record += h;
+        }
+        RecordHeader header{kRecordMagic, static_cast<uint32_t>(record.size() - sizeof(RecordHeader)), key.hi, key.lo, 0};
+        header.checksum = recordChecksum(record.data() + sizeof(RecordHeader), header.payloadLen, key.hi, key.lo);
+        std::memcpy(&record[0], &header, sizeof(header));
+        record.resize(align8(record.size()), '\0');
+
+        std::unique_lock<std::shared_mutex> lock(mutex_);
+        Slot* existing = find(key);
+        if (existing && valid(existing->offset - 1, key)) return true;
+
+        if (dataEnd_ + record.size() > dataCapacity_) return false;
+        if (!writeAt(dataFd_, record.data(), record.size(), dataEnd_)) return false;
+        uint64_t offset = dataEnd_;
+        dataEnd_ += record.size();
+
+        bool replacing = existing != nullptr;
+        IndexHeader* ih = indexHeader();
+        if ((ih->count + 1) * 2 > ih->capacity) {
+            if (!growIndex(ih->capacity * 2)) return false;
+            ih = indexHeader();
+        }
+
+        Slot* slot = find(key);
+        if (!slot) slot = emptySlotFor(key);
+        if (!slot) return false;
+        if (!replacing) ih->count++;
+        slot->hi = key.hi;
+        slot->lo = key.lo;
+        __atomic_store_n(&slot->offset, offset + 1, __ATOMIC_RELEASE);
+        return true;
+#endif
+    }
+
+    Stats stats() const {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        uint64_t entries = index_ ? reinterpret_cast<const mapped_store_detail::IndexHeader*>(index_)->count : 0;
+        return Stats{hits_.load(std::memory_order_relaxed), misses_.load(std::memory_order_relaxed),
+                     entries, dataEnd_, dataCapacity_};
+    }
+
+private:
+    mapped_store_detail::IndexHeader* indexHeader() const {
+        return reinterpret_cast<mapped_store_detail::IndexHeader*>(index_);
+    }
+
+    mapped_store_detail::Slot* slots() const {
+        return reinterpret_cast<mapped_store_detail::Slot*>(index_ + sizeof(mapped_store_detail::IndexHeader));
+    }
+
+    // Linear probe for `key`; returns its slot or nullptr at the first empty slot.
+    mapped_store_detail::Slot* find(const ChunkKey& key) const {
+        if (!index_) return nullptr;
+        uint64_t mask = indexHeader()->capacity - 1;
+        mapped_store_detail::Slot* s = slots();
+        for (uint64_t i = 0, pos = key.lo & mask; i <= mask; i++, pos = (pos + 1) & mask) {
+            uint64_t off = __atomic_load_n(&s[pos].offset, __ATOMIC_ACQUIRE);
+            if (off == 0) return nullptr;
+            if (s[pos].hi == key.hi && s[pos].lo == key.lo) return &s[pos];
+        }
+        return nullptr;
+    }
+
+    mapped_store_detail::Slot* emptySlotFor(const ChunkKey& key) const {
+        uint64_t mask = indexHeader()->capacity - 1;
+        mapped_store_detail::Slot* s = slots();
+        for (uint64_t i = 0, pos = key.lo & mask; i <= mask; i++, pos = (pos + 1) & mask) {
+            if (s[pos].offset == 0) return &s[pos];
+        }
+        return nullptr;
+    }
+
+    // Checks that a complete, intact record for `key` sits at `offset`.
+    bool valid(uint64_t offset, const ChunkKey& key) const {
+        using namespace mapped_store_detail;
+        if (offset % 8 != 0 || offset + sizeof(RecordHeader) > dataEnd_) return false;
+        RecordHeader h;
+        std::memcpy(&h, data_ + offset, sizeof(h));
+        if (h.magic != kRecordMagic || h.hi != key.hi || h.lo != key.lo) return false;
+        if (offset + sizeof(RecordHeader) + h.payloadLen > dataEnd_) return false;
+        return h.checksum == recordChecksum(data_ + offset + sizeof(RecordHeader), h.payloadLen, h.hi, h.lo);
+    }
+
+    // Reads the record at `offset` if it is an intact one for `key`; a slot
+    // left pointing at another key's record (a lost tail since reused) is a miss.
+    bool decode(uint64_t offset, const ChunkKey& key, std::vector<std::string>& out) const {
+        using namespace mapped_store_detail;
+        if (!valid(offset, key)) return false;
+        RecordHeader h;
+        std::memcpy(&h, data_ + offset, sizeof(h));
+
+        const char* p = data_ + offset + sizeof(RecordHeader);
+        const char* end = p + h.payloadLen;
+        uint32_t count;
+        if (end - p < 4) return false;
+        std::memcpy(&count, p, 4);
+        p += 4;
+        std::vector<std::string> result;
+        result.reserve(count);
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t len;
+            if (end - p < 4) return false;
+            std::memcpy(&len, p, 4);
+            p += 4;
+            if (static_cast<size_t>(end - p) < len) return false;
+            result.emplace_back(p, len);
+            p += len;
+        }
+        out = std::move(result);
+        return true;
+    }
+
+#ifndef _WIN32
+    static bool writeAt(int fd, const char* buf, size_t len, uint64_t offset) {
+        while (len > 0) {
+            ssize_t n = pwrite(fd, buf, len, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buf += n;
+            len -= static_cast<size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    // Maps chunks.idx if it exists and its header and size check out.
+    bool mapIndex() {
+        using namespace mapped_store_detail;
+        int fd = ::open(indexPath_.c_str(), O_RDWR);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(IndexHeader)) {
+            ::close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (map == MAP_FAILED) return false;
+
+        const IndexHeader* h = static_cast<const IndexHeader*>(map);
+        bool ok = h->magic == kIndexMagic && h->version == kIndexVersion && h->capacity >= kMinCapacity &&
+                  (h->capacity & (h->capacity - 1)) == 0 &&
+                  size == sizeof(IndexHeader) + h->capacity * sizeof(Slot);
+        if (!ok) {
+            munmap(map, size);
+            return false;
+        }
+        unmapIndex();
+        index_ = static_cast<char*>(map);
+        indexSize_ = size;
+        return true;
+    }
+
+    void unmapIndex() {
+        if (index_) munmap(index_, indexSize_);
+        index_ = nullptr;
+        indexSize_ = 0;
+    }
+
+    // Writes a fresh index holding `entries` to a temp file, then renames it
+    // over chunks.idx so a crash leaves either the old or the new index.
+    bool writeIndex(uint64_t capacity, const std::vector<std::pair<ChunkKey, uint64_t>>& entries) {
+        using namespace mapped_store_detail;
+        std::string tmp = indexPath_ + ".tmp";
+        size_t size = sizeof(IndexHeader) + capacity * sizeof(Slot);
+        int fd = ::open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        if (ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            ::close(fd);
+            return false;
+        }
+        void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (map == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+
+        IndexHeader* h = static_cast<IndexHeader*>(map);
+        h->magic = kIndexMagic;
+        h->version = kIndexVersion;
+        h->capacity = capacity;
+        h->count = entries.size();
+        Slot* s = reinterpret_cast<Slot*>(static_cast<char*>(map) + sizeof(IndexHeader));
+        uint64_t mask = capacity - 1;
+        for (auto& e : entries) {
+            uint64_t pos = e.first.lo & mask;
+            while (s[pos].offset != 0) pos = (pos + 1) & mask;
+            s[pos] = Slot{e.first.hi, e.first.lo, e.second + 1};
+        }
+
+        bool ok = msync(map, size, MS_SYNC) == 0 && fsync(fd) == 0;
+        munmap(map, size);
+        ::close(fd);
+        if (!ok || std::rename(tmp.c_str(), indexPath_.c_str()) != 0) return false;
+        return mapIndex();
+    }
+
+    // Recovers the index from the data file. Damaged stretches (a torn tail
+    // from a crash) are skipped by resyncing on the next aligned record magic.
+    bool rebuildIndex() {
+        using namespace mapped_store_detail;
+        std::vector<std::pair<ChunkKey, uint64_t>> entries;
+        for (uint64_t off = 0; off + sizeof(RecordHeader) <= dataEnd_;) {
+            RecordHeader h;
+            std::memcpy(&h, data_ + off, sizeof(h));
+            ChunkKey key{h.hi, h.lo};
+            if (h.magic == kRecordMagic && valid(off, key)) {
+                entries.emplace_back(key, off);
+                off += align8(sizeof(RecordHeader) + h.payloadLen);
+            } else {
+                off += 8;
+            }
+        }
+        uint64_t capacity = kMinCapacity;
+        while (capacity < entries.size() * 2) capacity *= 2;
+        return writeIndex(capacity, entries);
+    }
+
+    bool growIndex(uint64_t capacity) {
+        std::vector<std::pair<ChunkKey, uint64_t>> entries;
+        mapped_store_detail::Slot* s = slots();
+        for (uint64_t i = 0; i < indexHeader()->capacity; i++) {
+            if (s[i].offset != 0) entries.emplace_back(ChunkKey{s[i].hi, s[i].lo}, s[i].offset - 1);
+        }
+        return writeIndex(capacity, entries);
+    }
+#endif
+
+    void close() {
+#ifndef _WIN32
+        unmapIndex();
+        if (data_) munmap(const_cast<char*>(data_), dataCapacity_);
+        if (dataFd_ >= 0) ::close(dataFd_);
+#endif
+        data_ = nullptr;
+        dataFd_ = -1;
+    }
+
+    std::string dataPath_;
+    std::string indexPath_;
+    int dataFd_ = -1;
+    const char* data_ = nullptr;
+    uint64_t dataCapacity_ = 0;
+    uint64_t dataEnd_ = 0;
+    char* index_ = nullptr;
+    size_t indexSize_ = 0;
+
+    mutable std::shared_mutex mutex_;
+    std::atomic<uint64_t> hits_{0}, misses_{0};
+};
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+// ===========================
+//  Lock-free metrics
+// ===========================
+// Counters and histograms are split into cache-line-sized shards and each
+// thread always writes the same shard, so recording is a relaxed atomic add
+// on a line no other core is writing: no locks, no contention, a few ns.
+// Reading (a /metrics scrape) sums the shards.
+//
+// Histograms use HDR-style log-linear buckets: exact below 16, then 8 buckets
+// per power of two, so any value is placed within 12.5% of itself from 1 ns
+// up to ~4.9 hours.
+namespace metrics_detail {
+
+const size_t kShards = 16;
+
+// Threads take shards round-robin on first use
+inline size_t shardIndex() {
+    static std::atomic<size_t> next{0};
+    thread_local size_t shard = next.fetch_add(1, std::memory_order_relaxed) % kShards;
+    return shard;
+}
+
+struct alignas(64) PaddedCounter {
+    std::atomic<uint64_t> value{0};
+};
+
+} // namespace metrics_detail
+
+class Counter {
+public:
+    void add(uint64_t n = 1) {
+        shards_[metrics_detail::shardIndex()].value.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    uint64_t value() const {
+        uint64_t total = 0;
+        for (auto& s : shards_) total += s.value.load(std::memory_order_relaxed);
+        return total;
+    }
+
+private:
+    metrics_detail::PaddedCounter shards_[metrics_detail::kShards];
+};
+
+// Goes up and down (in-flight requests), so a single atomic is simplest;
+// these change once per request, not per chunk.
+class Gauge {
+public:
+    void add(int64_t delta) { value_.fetch_add(delta, std::memory_order_relaxed); }
+    int64_t value() const { return value_.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<int64_t> value_{0};
+};
+
+class Histogram {
+public:
+    static constexpr unsigned kSubBits = 3;
+    static constexpr uint64_t kSub = 1 << kSubBits;
+    static constexpr unsigned kMaxExponent = 44;
+    static constexpr size_t kBuckets = 2 * kSub + (kMaxExponent - kSubBits - 1) * kSub;
+
+    struct Snapshot {
+        std::vector<uint64_t> counts; // per bucket
+        uint64_t count = 0;
+        uint64_t sum = 0;
+    };
+
+    void record(uint64_t value) {
+        Shard& s = shards_[metrics_detail::shardIndex()];
+        s.counts[bucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+        s.sum.fetch_add(value, std::memory_order_relaxed);
+    }
+
+    void recordSince(std::chrono::steady_clock::time_point start) {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        record(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+    }
+
+    Snapshot snapshot() const {
+        Snapshot snap;
+        snap.counts.assign(kBuckets, 0);
+        for (auto& s : shards_) {
+            for (size_t i = 0; i < kBuckets; i++) snap.counts[i] += s.counts[i].load(std::memory_order_relaxed);
+            snap.sum += s.sum.load(std::memory_order_relaxed);
+        }
+        for (uint64_t c : snap.counts) snap.count += c;
+        return snap;
+    }
+
+    static size_t bucketOf(uint64_t v) {
+        if (v < 2 * kSub) return static_cast<size_t>(v);
+        unsigned exponent = 63 - static_cast<unsigned>(__builtin_clzll(v));
+        if (exponent >= kMaxExponent) return kBuckets - 1;
+        uint64_t sub = (v >> (exponent - kSubBits)) & (kSub - 1);
+        return static_cast<size_t>(2 * kSub + (exponent - kSubBits - 1) * kSub + sub);
+    }
+
+    // Smallest value that lands in bucket i (i == kBuckets: the end of range)
+    static uint64_t lowerBound(size_t i) {
+        if (i < 2 * kSub) return i;
+        uint64_t exponent = (i - 2 * kSub) / kSub + kSubBits + 1;
+        uint64_t sub = (i - 2 * kSub) % kSub;
+        return (kSub + sub) << (exponent - kSubBits);
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<uint64_t> counts[kBuckets] = {};
+        std::atomic<uint64_t> sum{0};
+    };
+    Shard shards_[metrics_detail::kShards];
+};
+
+// Records the time from construction to destruction.
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram& histogram,
+                         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now())
+        : histogram_(histogram), start_(start) {}
+    ~ScopedTimer() { histogram_.recordSince(start_); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    Histogram& histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// ===========================
+//  Prometheus text format
+// ===========================
+namespace metrics_detail {
+
+inline std::string formatNumber(double v) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.9g", v);
+    return buf;
+}
+
+inline std::string withLabel(const std::string& labels, const std::string& extra) {
+    return "{" + labels + (labels.empty() ? "" : ",") + extra + "}";
+}
+
+} // namespace metrics_detail
+
+inline void writeHeader(std::string& out, const std::string& name, const char* type, const std::string& help) {
+    out += "# HELP " + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+// One sample; labels like `stage="parse"`, or empty.
+inline void writeSample(std::string& out, const std::string& name, const std::string& labels, double value) {
+    out += name + (labels.empty() ? "" : "{" + labels + "}") + " " + metrics_detail::formatNumber(value) + "\n";
+}
+
+// Cumulative buckets at `bounds` (in output units; recorded values are
+// multiplied by `scale` first). A recorded bucket counts toward the first
+// bound at or above its midpoint, so bucket edges are as exact as the HDR
+// buckets themselves.
+inline void writeHistogram(std::string& out, const std::string& name, const std::string& labels,
+                           const Histogram::Snapshot& snap, double scale, const std::vector<double>& bounds) {
+    using namespace metrics_detail;
+    uint64_t cumulative = 0;
+    size_t bucket = 0;
+    for (double bound : bounds) {
+        while (bucket < snap.counts.size() &&
+               (Histogram::lowerBound(bucket) + Histogram::lowerBound(bucket + 1) - 1) / 2.0 * scale <= bound) {
+            cumulative += snap.counts[bucket++];
+        }
+        out += name + "_bucket" + withLabel(labels, "le=\"" + formatNumber(bound) + "\"") + " " +
+               std::to_string(cumulative) + "\n";
+    }
+    out += name + "_bucket" + withLabel(labels, "le=\"+Inf\"") + " " + std::to_string(snap.count) + "\n";
+    writeSample(out, name + "_sum", labels, snap.sum * scale);
+    writeSample(out, name + "_count", labels, static_cast<double>(snap.count));
+}
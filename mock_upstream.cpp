@@ -0,0 +1,186 @@
+#define CROW_MAIN
+#define CROW_USE_BOOST
+#include "crow_all.h"
+#include "worker_pool.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <random>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <functional>
+
+using namespace std;
+
+// ===========================
+//  Mock chat-completions server
+// ===========================
+// Stands in for the OpenAI API so /analyze can be load-tested without
+// spending credits. Point the analyzer at it with
+//   OPENAI_BASE_URL=http://127.0.0.1:9000/v1 OPENAI_API_KEY=mock ./server
+// Every knob is an environment variable:
+//   MOCK_PORT                 listen port (9000)
+//   MOCK_LATENCY_MS           typical answer time (300)
+//   MOCK_LATENCY_DIST         fixed | uniform (0 to 2x) | exponential (mean) |
+//                             lognormal (median; spread MOCK_LATENCY_SIGMA/100, default 50)
+//   MOCK_SLOW_PCT / MOCK_SLOW_MS  share of calls that take MOCK_SLOW_MS instead (0 / 5000)
+//   MOCK_ERROR_PCT            share answered 500 (0)
+//   MOCK_429_PCT              share answered 429 with retry-after-ms: 1000 (0)
+//   MOCK_HIGHLIGHTS           file of canned highlights, one per line (built-in list)
+//   MOCK_HIGHLIGHTS_PER_CHUNK highlights per answer (3)
+// GET /stats returns request counters.
+
+const vector<string> kDefaultHighlights = {
+    "We may share your personal information with third parties for advertising purposes.",
+    "You agree to resolve any dispute through binding arbitration and waive your right to a class action.",
+    "We may change these terms at any time without prior notice.",
+    "Subscription fees are non-refundable and your plan will automatically renew.",
+    "The service is provided as is and we are not liable for any damages.",
+    "We may terminate or suspend your account at our sole discretion.",
+    "You grant us a perpetual, irrevocable, royalty-free worldwide license to your content.",
+    "We retain your data after a request for erasure where required for our business.",
+};
+
+struct MockConfig {
+    string dist = "fixed";
+    double latencyMs = 300;
+    double sigma = 0.5;
+    size_t slowPct = 0;
+    double slowMs = 5000;
+    size_t errorPct = 0;
+    size_t rateLimitPct = 0;
+    size_t perChunk = 3;
+    vector<string> highlights = kDefaultHighlights;
+};
+
+MockConfig loadConfig() {
+    MockConfig c;
+    if (const char* dist = getenv("MOCK_LATENCY_DIST")) c.dist = dist;
+    c.latencyMs = envSize("MOCK_LATENCY_MS", 300);
+    c.sigma = envSize("MOCK_LATENCY_SIGMA", 50) / 100.0;
+    c.slowPct = envSize("MOCK_SLOW_PCT", 0);
+    c.slowMs = envSize("MOCK_SLOW_MS", 5000);
+    c.errorPct = envSize("MOCK_ERROR_PCT", 0);
+    c.rateLimitPct = envSize("MOCK_429_PCT", 0);
+    c.perChunk = envSize("MOCK_HIGHLIGHTS_PER_CHUNK", 3);
+
+    if (const char* path = getenv("MOCK_HIGHLIGHTS")) {
+        ifstream file(path);
+        if (!file.is_open()) {
+            cout << "Cannot read MOCK_HIGHLIGHTS file " << path << ", using the built-in list\n";
+        } else {
+            vector<string> lines;
+            string line;
+            while (getline(file, line)) {
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                if (!line.empty()) lines.push_back(line);
+            }
+            if (!lines.empty()) c.highlights = lines;
+        }
+    }
+    return c;
+}
+
+mt19937_64& rng() {
+    thread_local mt19937_64 gen{random_device{}()};
+    return gen;
+}
+
+// Percent chance, 0-100
+bool roll(size_t pct) {
+    return pct > 0 && uniform_int_distribution<size_t>(0, 99)(rng()) < pct;
+}
+
+chrono::milliseconds pickLatency(const MockConfig& c) {
+    double ms = c.latencyMs;
+    if (roll(c.slowPct)) {
+        ms = c.slowMs;
+    } else if (c.dist == "uniform") {
+        ms = uniform_real_distribution<double>(0, 2 * c.latencyMs)(rng());
+    } else if (c.dist == "exponential") {
+        ms = c.latencyMs > 0 ? exponential_distribution<double>(1 / c.latencyMs)(rng()) : 0;
+    } else if (c.dist == "lognormal") {
+        ms = c.latencyMs > 0 ? lognormal_distribution<double>(log(c.latencyMs), c.sigma)(rng()) : 0;
+    }
+    return chrono::milliseconds(static_cast<long long>(ms));
+}
+
+// The same chunk always gets the same highlights, so repeated runs compare.
+string completionBody(const MockConfig& c, const string& prompt) {
+    crow::json::wvalue inner;
+    inner["highlights"] = crow::json::wvalue::list();
+    size_t seed = hash<string>()(prompt);
+    for (size_t i = 0; i < c.perChunk && !c.highlights.empty(); i++) {
+        inner["highlights"][i] = c.highlights[(seed + i) % c.highlights.size()];
+    }
+
+    crow::json::wvalue out;
+    out["object"] = "chat.completion";
+    out["model"] = "mock";
+    out["choices"][0]["index"] = 0;
+    out["choices"][0]["finish_reason"] = "stop";
+    out["choices"][0]["message"]["role"] = "assistant";
+    out["choices"][0]["message"]["content"] = inner.dump();
+    return out.dump();
+}
+
+int main() {
+    static const MockConfig config = loadConfig();
+    static atomic<uint64_t> requests{0}, errors{0}, rateLimited{0};
+    size_t port = envSize("MOCK_PORT", 9000);
+
+    crow::SimpleApp app;
+    app.loglevel(crow::LogLevel::Warning);
+
+    CROW_ROUTE(app, "/v1/chat/completions").methods(crow::HTTPMethod::Post)
+    ([](const crow::request& req, crow::response& res) {
+        requests.fetch_add(1, memory_order_relaxed);
+
+        int code = 200;
+        string body;
+        if (roll(config.rateLimitPct)) {
+            code = 429;
+            rateLimited.fetch_add(1, memory_order_relaxed);
+            res.set_header("retry-after-ms", "1000");
+            body = R"({"error":{"message":"Rate limit reached, mock","type":"requests"}})";
+        } else if (roll(config.errorPct)) {
+            code = 500;
+            errors.fetch_add(1, memory_order_relaxed);
+            body = R"({"error":{"message":"Internal error, mock","type":"server_error"}})";
+        } else {
+            auto parsed = crow::json::load(req.body);
+            string prompt;
+            if (parsed && parsed.has("messages") && parsed["messages"].size() > 0) {
+                auto& last = parsed["messages"][parsed["messages"].size() - 1];
+                if (last.has("content")) prompt = last["content"].s();
+            }
+            body = completionBody(config, prompt);
+        }
+
+        // Answer from a timer on the connection's own I/O thread, so a slow
+        // answer holds no server thread.
+        auto timer = make_shared<crow::asio::steady_timer>(*req.io_context, pickLatency(config));
+        timer->async_wait([timer, &res, code, body](const crow::error_code&) {
+            res.code = code;
+            res.set_header("Content-Type", "application/json");
+            res.body = body;
+            res.end();
+        });
+    });
+
+    CROW_ROUTE(app, "/stats")
+    ([]() {
+        crow::json::wvalue out;
+        out["requests"] = requests.load(memory_order_relaxed);
+        out["errors"] = errors.load(memory_order_relaxed);
+        out["rateLimited"] = rateLimited.load(memory_order_relaxed);
+        return out;
+    });
+
+    cout << "Mock chat-completions server on port " << port << " (" << config.dist << ", "
+         << config.latencyMs << " ms)...\n";
+    app.port(static_cast<uint16_t>(port)).multithreaded().run();
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "chunking.h"
+#include "phrase_matcher.h"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ===========================
+//  Offline clause ranking
+// ===========================
+// Local stand-in for the model: scores every sentence of a chunk by the
+// weighted risk phrases it contains and returns the best ones as highlights.
+// One automaton pass per chunk, so a 100 KB document takes well under a
+// millisecond in total. Cruder than the model, but always available.
+struct RiskFeature {
+    const char* phrase;
+    int weight;
+};
+
+const RiskFeature kDefaultRiskFeatures[] = {
+    // data sharing and tracking
+    {"share your personal information", 6}, {"share your personal data", 6}, {"sell your", 6},
+    {"third-party cookies", 5}, {"tracks you", 5}, {"track you", 5}, {"read your private messages", 6},
+    {"biometric", 5}, {"location data", 4}, {"personal data", 3}, {"personal information", 3},
+    {"third part", 3}, {"affiliates", 2}, {"share", 2}, {"disclose", 3}, {"advertis", 2}, {"cookie", 2},
+    {"collect", 2}, {"retain", 2}, {"after a request for erasure", 5}, {"without your consent", 5},
+    // liability
+    {"not liable", 5}, {"no liability", 5}, {"limitation of liability", 5}, {"indemnif", 5}, {"as is", 4},
+    {"at your own risk", 4}, {"disclaim", 3}, {"liabilit", 3}, {"damages", 2}, {"warrant", 2},
+    // fees and billing
+    {"non-refundable", 5}, {"automatically renew", 5}, {"auto-renew", 5}, {"cancellation fee", 5},
+    {"late fee", 4}, {"fee", 2}, {"charge", 2}, {"refund", 2}, {"billing", 2}, {"subscription", 2},
+    // disputes
+    {"binding arbitration", 6}, {"class action", 5}, {"waive your right", 6}, {"jury trial", 5},
+    {"arbitrat", 3}, {"governing law", 2}, {"jurisdiction", 2},
+    // unilateral changes and termination
+    {"without prior notice", 5}, {"without notice", 5}, {"without a reason", 4}, {"at any time", 3},
+    {"sole discretion", 5}, {"we reserve the right", 3}, {"change these terms", 4}, {"modify these terms", 4},
+    {"terminat", 2}, {"suspend", 2}, {"delete", 2},
+    // content rights
+    {"perpetual", 4}, {"irrevocable", 4}, {"royalty-free", 4}, {"worldwide license", 4}, {"moral rights", 5},
+    {"your content", 2}, {"license", 2},
+};
+
+class OfflineAnalyzer {
+public:
+    OfflineAnalyzer() {
+        for (auto& f : kDefaultRiskFeatures) matcher_.add(f.phrase, f.weight);
+        matcher_.build();
+    }
+
+    // Sentences scoring at least minScore, best first, at most maxHighlights.
+    std::vector<std::string> analyze(std::string_view chunk, size_t maxHighlights = 8, int minScore = 5) const {
+        using namespace chunk_detail;
+        struct Sentence {
+            size_t begin, end;
+            int score;
+        };
+
+        std::vector<Sentence> sentences;
+        const char* p = chunk.data();
+        size_t n = chunk.size();
+        for (size_t pos = 0; pos < n;) {
+            size_t k = pos + findTerminator(p + pos, n - pos);
+            size_t end = k < n ? sentenceEndAfter(p, k, n) : n;
+            sentences.push_back(Sentence{pos, end, 0});
+            pos = end;
+        }
+
+        // Matches arrive in order of where they end; credit the sentence
+        // each one starts in.
+        size_t cursor = 0;
+        matcher_.scan(chunk, [&](size_t id, size_t begin) {
+            while (cursor > 0 && sentences[cursor].begin > begin) cursor--;
+            while (cursor + 1 < sentences.size() && sentences[cursor].end <= begin) cursor++;
+            sentences[cursor].score += matcher_.weight(id);
+        });
+
+        std::vector<const Sentence*> ranked;
+        for (auto& s : sentences) {
+            if (s.score >= minScore) ranked.push_back(&s);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(),
+                         [](const Sentence* a, const Sentence* b) { return a->score > b->score; });
+        if (ranked.size() > maxHighlights) ranked.resize(maxHighlights);
+
+        std::vector<std::string> highlights;
+        highlights.reserve(ranked.size());
+        for (const Sentence* s : ranked) {
+            highlights.push_back(clean(chunk.substr(s->begin, s->end - s->begin)));
+        }
+        return highlights;
+    }
+
+private:
+    // Trimmed, internal whitespace runs folded to one space, long sentences
+    // cut at a word boundary.
+    static std::string clean(std::string_view sentence) {
+        const size_t maxChars = 300;
+        std::string out;
+        out.reserve(std::min(sentence.size(), maxChars + 3));
+        bool space = false;
+        for (char c : sentence) {
+            bool isSpace = c == ' ' || c == '\t' || c == '\n' || c == '\r';
+            if (isSpace) {
+                space = !out.empty();
+                continue;
+            }
+            if (space) out.push_back(' ');
+            space = false;
+            out.push_back(c);
+            if (out.size() >= maxChars) {
+                size_t cut = out.rfind(' ');
+                if (cut != std::string::npos && cut > maxChars / 2) out.resize(cut);
+                out += "...";
+                break;
+            }
+        }
+        return out;
+    }
+
+    PhraseMatcher matcher_;
+};
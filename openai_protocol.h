@@ -0,0 +1,113 @@
+#pragma once
+
+#include "crow_all.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The chat-completions wire format: the request payload for one chunk and
+// the highlights in the answer. Shared by the server and bench.cpp.
+
+// ===========================
+//  JSON string escaping
+// ===========================
+// Same output as crow::json::escape, but for a view and copying runs of
+// plain characters in one append.
+inline void appendJsonEscaped(std::string& out, std::string_view in) {
+    static const char hex[] = "0123456789abcdef";
+    size_t run = 0;
+    for (size_t i = 0; i < in.size(); i++) {
+        unsigned char c = static_cast<unsigned char>(in[i]);
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+
+        out.append(in.data() + run, i - run);
+        run = i + 1;
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\b': out += "\\b"; break;
+            case '\f': out += "\\f"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                out += "\\u00";
+                out += hex[c >> 4];
+                out += hex[c & 0xf];
+                break;
+        }
+    }
+    out.append(in.data() + run, in.size() - run);
+}
+
+// ===========================
+//  Build the chat-completions payload
+// ===========================
+const char* const kModel = "gpt-4o-mini";
+const int kMaxTokens = 800;
+// Bump whenever kSystemPrompt or the user message wording changes, so cached
+// highlights from the old prompt stop matching.
+const int kPromptVersion = 1;
+const char* const kSystemPrompt =
+    "You are analyzing Terms of Service. Extract important clauses about privacy, data collection, liability, fees, and user rights. "
+    "Respond ONLY with valid JSON: {\"highlights\": [\"clause1\", \"clause2\", ...]}";
+
+// Writes the request JSON straight into `out`, escaping the chunk text once.
+// Same document as dumping the equivalent wvalue, without building the tree.
+inline void buildChatPayload(std::string& out, std::string_view tosChunk, int chunkNum, int totalChunks) {
+    static const std::string escapedSystem = crow::json::escape(kSystemPrompt);
+
+    out.reserve(out.size() + escapedSystem.size() + tosChunk.size() + tosChunk.size() / 8 + 256);
+    out += "{\"model\":\"";
+    out += kModel;
+    out += "\",\"max_tokens\":";
+    out += std::to_string(kMaxTokens);
+    out += ",\"messages\":[{\"role\":\"system\",\"content\":\"";
+    out += escapedSystem;
+    out += "\"},{\"role\":\"user\",\"content\":\"This is part ";
+    out += std::to_string(chunkNum);
+    out += " of ";
+    out += std::to_string(totalChunks);
+    out += " of a Terms of Service. Extract important clauses:\\n\\n";
+    appendJsonEscaped(out, tosChunk);
+    out += "\"}]}";
+}
+
+// ===========================
+//  Pull highlights out of an OpenAI response
+// ===========================
+// Returns false when the response is not a usable answer (transport failure,
+// upstream error, malformed body), so callers know not to cache it.
+inline bool extractHighlights(const std::string& response, size_t chunkNum, std::vector<std::string>& highlights) {
+    using crow::json::type;
+
+    // Parse response
+    auto parsed = crow::json::load(response);
+    if (!parsed || parsed.t() != type::Object) return false;
+
+    // Handle error
+    if (parsed.has("error")) {
+        CROW_LOG_WARNING << "Error in chunk " << chunkNum;
+        return false;
+    }
+
+    // Extract highlights from choices[0].message.content. The body comes from
+    // outside, so every level is type-checked: rvalue accessors throw on a
+    // type mismatch.
+    if (!parsed.has("choices") || parsed["choices"].t() != type::List || parsed["choices"].size() == 0) return false;
+    auto& choice = parsed["choices"][0];
+    if (choice.t() != type::Object || !choice.has("message")) return false;
+    auto& message = choice["message"];
+    if (message.t() != type::Object || !message.has("content") || message["content"].t() != type::String) return false;
+
+    // Parse the inner JSON; entries that are not strings are skipped
+    auto inner = crow::json::load(message["content"].s());
+    if (!inner || inner.t() != type::Object || !inner.has("highlights")) return false;
+    auto& list = inner["highlights"];
+    if (list.t() != type::List) return false;
+    for (size_t j = 0; j < list.size(); j++) {
+        if (list[j].t() == type::String) highlights.push_back(list[j].s());
+    }
+    return true;
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// ===========================
+//  Multi-phrase matcher (Aho-Corasick)
+// ===========================
+// Finds every occurrence of a set of weighted phrases in one pass over the
+// text, however many phrases there are. Matching is ASCII case-insensitive,
+// any whitespace byte matches a space, and a phrase only matches at the start
+// of a word ("fee" hits "fees" but not "coffee"), so stems like "arbitrat"
+// work as prefixes.
+//
+// add() every phrase, then build() once; scan() and score() are read-only
+// and safe to call from many threads.
+class PhraseMatcher {
+public:
+    void add(std::string_view phrase, int weight = 1) {
+        std::string p = normalize(phrase);
+        if (p.empty()) return;
+        for (size_t i = 0; i < phrases_.size(); i++) {
+            if (phrases_[i].text == p) {
+                phrases_[i].weight = weight;
+                return;
+            }
+        }
+        phrases_.push_back(Phrase{std::move(p), weight});
+    }
+
+    void build() {
+        // Byte classes: 0 is "not in any phrase", which always leads back to
+        // the root, so the table only needs one column per distinct byte.
+        for (auto& c : classOf_) c = 0;
+        alphabet_ = 1;
+        for (auto& ph : phrases_) {
+            for (unsigned char c : ph.text) {
+                if (!classOf_[c]) classOf_[c] = static_cast<uint16_t>(alphabet_++);
+            }
+        }
+        for (int c = 'A'; c <= 'Z'; c++) classOf_[c] = classOf_[c - 'A' + 'a'];
+        for (unsigned char c : {'\t', '\n', '\r', '\f', '\v'}) classOf_[c] = classOf_[' '];
+
+        next_.assign(alphabet_, -1);
+        fail_.assign(1, 0);
+        output_.assign(1, -1);
+        dictLink_.assign(1, -1);
+        for (size_t id = 0; id < phrases_.size(); id++) {
+            int32_t node = 0;
+            for (unsigned char c : phrases_[id].text) {
+                int32_t& slot = next_[node * alphabet_ + classOf_[c]];
+                if (slot < 0) {
+                    slot = static_cast<int32_t>(fail_.size());
+                    next_.resize(next_.size() + alphabet_, -1);
+                    fail_.push_back(0);
+                    output_.push_back(-1);
+                    dictLink_.push_back(-1);
+                }
+                node = next_[node * alphabet_ + classOf_[c]];
+            }
+            output_[node] = static_cast<int32_t>(id);
+        }
+
+        // Breadth-first: fill missing edges from the failure node so scanning
+        // is one table lookup per byte.
+        std::deque<int32_t> queue;
+        for (size_t a = 0; a < alphabet_; a++) {
+            int32_t& child = next_[a];
+            if (child < 0) {
+                child = 0;
+            } else {
+                fail_[child] = 0;
+                queue.push_back(child);
+            }
+        }
+        next_[0] = 0;
+        while (!queue.empty()) {
+            int32_t node = queue.front();
+            queue.pop_front();
+            int32_t f = fail_[node];
+            dictLink_[node] = output_[f] >= 0 ? f : dictLink_[f];
+            for (size_t a = 1; a < alphabet_; a++) {
+                int32_t& child = next_[node * alphabet_ + a];
+                int32_t viaFail = next_[f * alphabet_ + a];
+                if (child < 0) {
+                    child = viaFail;
+                } else {
+                    fail_[child] = viaFail;
+                    queue.push_back(child);
+                }
+            }
+            next_[node * alphabet_] = 0;
+        }
+    }
+
+    size_t size() const { return phrases_.size(); }
+    const std::string& phrase(size_t id) const { return phrases_[id].text; }
+    int weight(size_t id) const { return phrases_[id].weight; }
+
+    // Calls onMatch(phraseId, begin) for each match, begin being the offset of
+    // its first byte in `text`.
+    template <typename OnMatch>
+    void scan(std::string_view text, OnMatch&& onMatch) const {
+        if (fail_.empty()) return;
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+        int32_t node = 0;
+        for (size_t i = 0; i < text.size(); i++) {
+            node = next_[node * alphabet_ + classOf_[p[i]]];
+            for (int32_t n = output_[node] >= 0 ? node : dictLink_[node]; n >= 0; n = dictLink_[n]) {
+                size_t id = static_cast<size_t>(output_[n]);
+                size_t begin = i + 1 - phrases_[id].text.size();
+                if (begin == 0 || !isWordByte(p[begin - 1])) onMatch(id, begin);
+            }
+        }
+    }
+
+    // Sum of the weights of every match.
+    int score(std::string_view text) const {
+        int total = 0;
+        scan(text, [&](size_t id, size_t) { total += phrases_[id].weight; });
+        return total;
+    }
+
+private:
+    struct Phrase {
+        std::string text;
+        int weight;
+    };
+
+    static bool isWordByte(unsigned char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+    }
+
+    static std::string normalize(std::string_view phrase) {
+        std::string out;
+        out.reserve(phrase.size());
+        for (unsigned char c : phrase) {
+            if (c >= 'A' && c <= 'Z') c = static_cast<unsigned char>(c - 'A' + 'a');
+            if (c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v') c = ' ';
+            out.push_back(static_cast<char>(c));
+        }
+        return out;
+    }
+
+    std::vector<Phrase> phrases_;
+    uint16_t classOf_[256] = {};
+    size_t alphabet_ = 1;
+    std::vector<int32_t> next_;     // node * alphabet_ + class -> node
+    std::vector<int32_t> fail_;
+    std::vector<int32_t> output_;   // phrase ending at this node, or -1
+    std::vector<int32_t> dictLink_; // nearest suffix node with an output, or -1
+};
@@ -0,0 +1,218 @@
+#pragma once
+
+#include "upstream_client.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+
+// ===========================
+//  Upstream rate limiter
+// ===========================
+// Two token buckets, one for requests per minute and one for tokens per
+// minute, shared by every chunk call. A call waits until both buckets are out
+// of debt, then takes its cost (which may put them into debt), so the long-run
+// rate is exactly the limit and a request larger than the burst still goes.
+//
+// The limits adapt to what the upstream reports:
+//   - x-ratelimit-limit-* replaces the configured limit,
+//   - x-ratelimit-remaining-* of 0 holds calls until x-ratelimit-reset-*,
+//   - a 429 holds calls for retry-after and halves the rate (once per
+//     second, so one burst of 429s counts once); successful calls give back
+//     2% of the full rate per second (AIMD), so the rate settles just under
+//     the quota instead of oscillating around it.
+// A limit of 0 means "unknown": no limiting until a header supplies one.
+namespace rate_detail {
+
+using Clock = std::chrono::steady_clock;
+
+// OpenAI-style durations: "20ms", "1s", "6m0s", "1h2m3.5s", or plain seconds.
+inline bool parseDuration(const std::string& text, std::chrono::milliseconds& out) {
+    if (text.empty()) return false;
+    double total = 0;
+    const char* p = text.c_str();
+    bool any = false;
+    while (*p) {
+        char* end = nullptr;
+        double v = std::strtod(p, &end);
+        if (end == p) return false;
+        p = end;
+        if (p[0] == 'm' && p[1] == 's') {
+            total += v / 1000;
+            p += 2;
+        } else if (*p == 'h') {
+            total += v * 3600;
+            p++;
+        } else if (*p == 'm') {
+            total += v * 60;
+            p++;
+        } else if (*p == 's') {
+            total += v;
+            p++;
+        } else if (*p == '\0' && !any) {
+            total += v;
+        } else {
+            return false;
+        }
+        any = true;
+    }
+    out = std::chrono::milliseconds(static_cast<long long>(total * 1000));
+    return true;
+}
+
+struct Bucket {
+    double limitPerMinute = 0; // 0 = unlimited
+    double level = 0;          // available units; negative is debt
+    Clock::time_point last = Clock::now();
+
+    double burst() const { return std::max(1.0, limitPerMinute / 10); }
+
+    void refill(Clock::time_point now, double factor) {
+        double seconds = std::chrono::duration<double>(now - last).count();
+        last = now;
+        if (limitPerMinute <= 0) return;
+        level = std::min(burst(), level + seconds * limitPerMinute * factor / 60);
+    }
+
+    // Time until the debt is paid off at the current rate
+    double secondsUntilReady(double factor) const {
+        if (limitPerMinute <= 0 || level >= 0) return 0;
+        return -level * 60 / (limitPerMinute * factor);
+    }
+};
+
+} // namespace rate_detail
+
+class RateLimiter {
+public:
+    struct Stats {
+        double requestsPerMinute, tokensPerMinute, rateFactor;
+        uint64_t waits, rateLimited;
+    };
+
+    RateLimiter(double requestsPerMinute, double tokensPerMinute) {
+        auto now = rate_detail::Clock::now();
+        requests_.limitPerMinute = requestsPerMinute;
+        tokens_.limitPerMinute = tokensPerMinute;
+        requests_.level = requests_.burst();
+        tokens_.level = tokens_.burst();
+        requests_.last = tokens_.last = now;
+    }
+
+    // Blocks until a call costing `tokens` may go. Returns false if that would
+    // take past `deadline`; nothing is taken then.
+    bool acquire(double tokens, rate_detail::Clock::time_point deadline) {
+        using namespace rate_detail;
+        std::unique_lock<std::mutex> lock(mutex_);
+        bool waited = false;
+        for (;;) {
+            Clock::time_point now = Clock::now();
+            requests_.refill(now, factor_);
+            tokens_.refill(now, factor_);
+
+            double wait = std::max(requests_.secondsUntilReady(factor_), tokens_.secondsUntilReady(factor_));
+            Clock::time_point readyAt = std::max(now + std::chrono::duration_cast<Clock::duration>(
+                                                           std::chrono::duration<double>(wait)),
+                                                 pausedUntil_);
+            if (readyAt <= now) {
+                if (requests_.limitPerMinute > 0) requests_.level -= 1;
+                if (tokens_.limitPerMinute > 0) tokens_.level -= tokens;
+                if (waited) waits_++;
+                return true;
+            }
+            if (readyAt > deadline) return false;
+
+            waited = true;
+            lock.unlock();
+            std::this_thread::sleep_until(std::min(readyAt, now + std::chrono::milliseconds(250)));
+            lock.lock();
+        }
+    }
+
+    // Feeds a finished call back into the limiter.
+    void observe(const HttpResponse& res) {
+        using namespace rate_detail;
+        std::lock_guard<std::mutex> lock(mutex_);
+        Clock::time_point now = Clock::now();
+        adopt(res, "requests", requests_, now);
+        adopt(res, "tokens", tokens_, now);
+
+        if (res.status == 429) {
+            rateLimited_++;
+            if (now - lastCut_ >= std::chrono::seconds(1)) {
+                factor_ = std::max(0.05, factor_ * 0.5);
+                lastCut_ = now;
+            }
+            // Saved-up burst is what just overran the quota
+            requests_.level = std::min(requests_.level, 0.0);
+            tokens_.level = std::min(tokens_.level, 0.0);
+            std::chrono::milliseconds pause(1000);
+            retryAfter(res, pause);
+            pausedUntil_ = std::max(pausedUntil_, now + pause);
+        } else if (res.status >= 200 && res.status < 300 && factor_ < 1.0) {
+            double seconds = std::chrono::duration<double>(now - std::max(lastGrow_, lastCut_)).count();
+            factor_ = std::min(1.0, factor_ + 0.02 * std::min(seconds, 5.0));
+            lastGrow_ = now;
+        }
+    }
+
+    // How long the upstream asked us to wait before retrying, if it said.
+    static bool retryAfter(const HttpResponse& res, std::chrono::milliseconds& out) {
+        std::string ms = res.header("retry-after-ms");
+        if (!ms.empty()) {
+            out = std::chrono::milliseconds(std::strtoll(ms.c_str(), nullptr, 10));
+            return true;
+        }
+        return rate_detail::parseDuration(res.header("retry-after"), out);
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Stats{requests_.limitPerMinute, tokens_.limitPerMinute, factor_, waits_, rateLimited_};
+    }
+
+private:
+    void adopt(const HttpResponse& res, const std::string& kind, rate_detail::Bucket& bucket,
+               rate_detail::Clock::time_point now) {
+        std::string limit = res.header("x-ratelimit-limit-" + kind);
+        if (!limit.empty()) {
+            double v = std::strtod(limit.c_str(), nullptr);
+            if (v > 0 && v != bucket.limitPerMinute) {
+                bucket.limitPerMinute = v;
+                bucket.level = std::min(bucket.level, bucket.burst());
+            }
+        }
+        std::string remaining = res.header("x-ratelimit-remaining-" + kind);
+        std::chrono::milliseconds reset;
+        if (!remaining.empty() && std::strtod(remaining.c_str(), nullptr) <= 0 &&
+            rate_detail::parseDuration(res.header("x-ratelimit-reset-" + kind), reset)) {
+            pausedUntil_ = std::max(pausedUntil_, now + reset);
+        }
+    }
+
+    std::mutex mutex_;
+    rate_detail::Bucket requests_, tokens_;
+    double factor_ = 1.0;
+    rate_detail::Clock::time_point pausedUntil_{};
+    rate_detail::Clock::time_point lastCut_{};
+    rate_detail::Clock::time_point lastGrow_{};
+    uint64_t waits_ = 0, rateLimited_ = 0;
+};
+
+// ===========================
+//  Retry backoff
+// ===========================
+// "Full jitter": a uniform pick in [0, min(cap, base * 2^attempt)], so
+// retries from many chunks spread out instead of arriving together.
+inline std::chrono::milliseconds jitteredBackoff(int attempt, std::chrono::milliseconds base,
+                                                 std::chrono::milliseconds cap) {
+    thread_local std::mt19937_64 rng{std::random_device{}()};
+    long long ceiling = std::min<long long>(cap.count(), base.count() << std::min(attempt, 20));
+    std::uniform_int_distribution<long long> pick(0, std::max(ceiling, 0LL));
+    return std::chrono::milliseconds(pick(rng));
+}
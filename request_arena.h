@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+
+// ===========================
+//  Per-request arena
+// ===========================
+// Scratch memory for one request's merge and serialization: allocations bump
+// a pointer through an inline block (on the stack of whoever owns the arena)
+// and then through heap blocks of growing size; deallocate is a no-op and
+// everything goes at once when the arena does. Not thread-safe - give each
+// request its own and use it from one thread.
+//
+// Pass resource() to std::pmr containers; nested pmr containers inherit it.
+class RequestArena {
+public:
+    static constexpr size_t kInlineBytes = 16 * 1024;
+
+    RequestArena() : resource_(inline_, sizeof(inline_), std::pmr::new_delete_resource()) {}
+
+    RequestArena(const RequestArena&) = delete;
+    RequestArena& operator=(const RequestArena&) = delete;
+
+    std::pmr::memory_resource* resource() { return &resource_; }
+
+private:
+    alignas(std::max_align_t) std::byte inline_[kInlineBytes];
+    std::pmr::monotonic_buffer_resource resource_;
+};
@@ -0,0 +1,191 @@
+#pragma once
+
+#include "crow_all.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ===========================
+//  Per-request stage tracing
+// ===========================
+// A traced request gets a Trace; code that runs on its behalf binds it to the
+// thread (TraceBinding) and marks stages with TraceSpan. Untraced requests pay
+// one thread-local load per span. toJson() is Chrome trace-event format, one
+// row per thread, so chunks running in parallel show up side by side in
+// chrome://tracing or Perfetto.
+class Trace {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    Trace(std::string id, std::string label) : id_(std::move(id)), label_(std::move(label)), start_(Clock::now()) {}
+
+    const std::string& id() const { return id_; }
+
+    void add(const char* name, const char* category, Clock::time_point begin, Clock::time_point end,
+             std::vector<std::pair<const char*, std::string>> args = {}) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto tid = threads_.emplace(std::this_thread::get_id(), static_cast<uint32_t>(threads_.size() + 1)).first->second;
+        events_.push_back(Event{name, category, tid, micros(begin), micros(end) - micros(begin), std::move(args)});
+    }
+
+    crow::json::wvalue toJson() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        crow::json::wvalue out;
+        out["displayTimeUnit"] = "ms";
+        out["otherData"]["id"] = id_;
+        out["otherData"]["request"] = label_;
+        auto& events = out["traceEvents"];
+        events = crow::json::wvalue::list();
+        size_t n = 0;
+        for (auto& t : threads_) {
+            auto& meta = events[n++];
+            meta["ph"] = "M";
+            meta["name"] = "thread_name";
+            meta["pid"] = 1;
+            meta["tid"] = t.second;
+            meta["args"]["name"] = "thread " + std::to_string(t.second);
+        }
+        for (auto& e : events_) {
+            auto& ev = events[n++];
+            ev["ph"] = "X";
+            ev["name"] = e.name;
+            ev["cat"] = e.category;
+            ev["pid"] = 1;
+            ev["tid"] = e.tid;
+            ev["ts"] = e.startUs;
+            ev["dur"] = e.durUs;
+            for (auto& a : e.args) ev["args"][a.first] = a.second;
+        }
+        return out;
+    }
+
+private:
+    struct Event {
+        const char* name;
+        const char* category;
+        uint32_t tid;
+        int64_t startUs, durUs;
+        std::vector<std::pair<const char*, std::string>> args;
+    };
+
+    int64_t micros(Clock::time_point t) const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(t - start_).count();
+    }
+
+    const std::string id_;
+    const std::string label_;
+    const Clock::time_point start_;
+    mutable std::mutex mutex_;
+    std::unordered_map<std::thread::id, uint32_t> threads_;
+    std::vector<Event> events_;
+};
+
+// The trace of whatever this thread is doing, if it is traced
+inline Trace*& currentTrace() {
+    thread_local Trace* trace = nullptr;
+    return trace;
+}
+
+// Makes `trace` current on this thread for the scope (nullptr is fine).
+class TraceBinding {
+public:
+    explicit TraceBinding(Trace* trace) : previous_(currentTrace()) { currentTrace() = trace; }
+    ~TraceBinding() { currentTrace() = previous_; }
+
+    TraceBinding(const TraceBinding&) = delete;
+    TraceBinding& operator=(const TraceBinding&) = delete;
+
+private:
+    Trace* previous_;
+};
+
+// Records [construction, destruction) on the current trace. name and
+// category must be string literals.
+class TraceSpan {
+public:
+    TraceSpan(const char* name, const char* category)
+        : trace_(currentTrace()), name_(name), category_(category) {
+        if (trace_) begin_ = Trace::Clock::now();
+    }
+
+    // Span that started earlier, e.g. time spent queued before this thread
+    // picked the work up
+    TraceSpan(const char* name, const char* category, Trace::Clock::time_point begin)
+        : trace_(currentTrace()), name_(name), category_(category), begin_(begin) {}
+
+    ~TraceSpan() {
+        if (trace_) trace_->add(name_, category_, begin_, Trace::Clock::now(), std::move(args_));
+    }
+
+    bool active() const { return trace_ != nullptr; }
+
+    void arg(const char* key, std::string value) {
+        if (trace_) args_.emplace_back(key, std::move(value));
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    Trace* trace_;
+    const char* name_;
+    const char* category_;
+    Trace::Clock::time_point begin_;
+    std::vector<std::pair<const char*, std::string>> args_;
+};
+
+// ===========================
+//  Recent traces
+// ===========================
+// Keeps the last `keep` traces for /debug/traces/{id}; older ones are dropped.
+class TraceStore {
+public:
+    explicit TraceStore(size_t keep) : keep_(keep ? keep : 1) {}
+
+    std::shared_ptr<Trace> create(const std::string& label) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::string id;
+        do {
+            char buf[17];
+            std::snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(rng_()));
+            id = buf;
+        } while (traces_.count(id));
+        auto trace = std::make_shared<Trace>(id, label);
+        traces_[id] = trace;
+        order_.push_back(id);
+        while (order_.size() > keep_) {
+            traces_.erase(order_.front());
+            order_.pop_front();
+        }
+        return trace;
+    }
+
+    std::shared_ptr<Trace> get(const std::string& id) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = traces_.find(id);
+        return it == traces_.end() ? nullptr : it->second;
+    }
+
+    // Newest first
+    std::vector<std::string> ids() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return std::vector<std::string>(order_.rbegin(), order_.rend());
+    }
+
+private:
+    const size_t keep_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<Trace>> traces_;
+    std::deque<std::string> order_;
+    std::mt19937_64 rng_{std::random_device{}()};
+};
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+// ===========================
+//  Coalesce identical in-flight calls
+// ===========================
+// run(key, fn) calls fn() unless a call for the same key is already running;
+// then it waits for that call and returns a copy of its result (or rethrows
+// its exception). Nothing is kept once the call finishes, so this dedupes
+// concurrent work only; repeat work later is the caches' job.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
+class SingleFlight {
+public:
+    struct Stats {
+        uint64_t leaders, followers, inFlight;
+    };
+
+    template <typename F>
+    Value run(const Key& key, F&& fn) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto it = calls_.find(key);
+        if (it != calls_.end()) {
+            std::shared_future<Value> pending = it->second;
+            lock.unlock();
+            followers_.fetch_add(1, std::memory_order_relaxed);
+            return pending.get();
+        }
+
+        std::promise<Value> promise;
+        calls_.emplace(key, promise.get_future().share());
+        lock.unlock();
+        leaders_.fetch_add(1, std::memory_order_relaxed);
+
+        try {
+            Value value = fn();
+            forget(key);
+            promise.set_value(value);
+            return value;
+        } catch (...) {
+            forget(key);
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    Stats stats() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return Stats{leaders_.load(std::memory_order_relaxed),
+                     followers_.load(std::memory_order_relaxed),
+                     static_cast<uint64_t>(calls_.size())};
+    }
+
+private:
+    void forget(const Key& key) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        calls_.erase(key);
+    }
+
+    std::mutex mutex_;
+    std::unordered_map<Key, std::shared_future<Value>, Hash> calls_;
+    std::atomic<uint64_t> leaders_{0}, followers_{0};
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+// ===========================
+//  Local token-count estimate
+// ===========================
+// Approximates what a GPT BPE tokenizer (cl100k / o200k) would produce without
+// loading a vocabulary. It walks the same pre-tokenization pieces those
+// tokenizers split on (a word with its leading space, digit groups of up to
+// three, punctuation runs, newline runs) and charges each piece by length:
+// short and common words are one token, long words get one more per ~6
+// letters, CJK and other 3-4 byte UTF-8 characters cost one each. It is a
+// sizing estimate (about 4-5 characters per token on English prose), good
+// enough to pack chunks and budget rate limits, not an exact count.
+namespace token_detail {
+
+inline bool isLetter(unsigned char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= 0x80 && c < 0xe0);
+}
+
+inline bool isDigit(unsigned char c) { return c >= '0' && c <= '9'; }
+
+inline bool isSpace(unsigned char c) { return c == ' ' || c == '\t'; }
+
+inline bool isNewline(unsigned char c) { return c == '\n' || c == '\r'; }
+
+inline size_t wordTokens(size_t letters) {
+    return letters <= 10 ? 1 : 1 + (letters - 5) / 6;
+}
+
+// Tokens for the piece starting at p[i]; moves i past it.
+inline size_t nextPiece(const unsigned char* p, size_t n, size_t& i) {
+    unsigned char c = p[i];
+
+    // A single space is folded into the piece that follows it
+    if (c == ' ' && i + 1 < n && !isSpace(p[i + 1]) && !isNewline(p[i + 1])) {
+        c = p[++i];
+    }
+
+    if (isLetter(c)) {
+        size_t start = i;
+        while (i < n && isLetter(p[i])) i++;
+        // Continuation bytes of 2-byte UTF-8 count toward the same letter
+        size_t letters = 0;
+        for (size_t j = start; j < i; j++) letters += (p[j] & 0xc0) != 0x80;
+        return wordTokens(letters);
+    }
+    if (isDigit(c)) {
+        size_t start = i;
+        while (i < n && isDigit(p[i])) i++;
+        return (i - start + 2) / 3;
+    }
+    if (isNewline(c)) {
+        while (i < n && (isNewline(p[i]) || isSpace(p[i]))) i++;
+        return 1;
+    }
+    if (isSpace(c)) {
+        while (i < n && isSpace(p[i])) i++;
+        return 1;
+    }
+    if (c >= 0xe0) {
+        // 3- and 4-byte UTF-8 sequences (CJK, emoji): about one token each
+        i++;
+        while (i < n && (p[i] & 0xc0) == 0x80) i++;
+        return 1;
+    }
+    size_t start = i;
+    while (i < n && !isLetter(p[i]) && !isDigit(p[i]) && !isSpace(p[i]) && !isNewline(p[i]) && p[i] < 0xe0) i++;
+    return (i - start + 1) / 2;
+}
+
+} // namespace token_detail
+
+inline size_t estimateTokens(std::string_view text) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(text.data());
+    size_t n = text.size();
+    size_t tokens = 0;
+    size_t i = 0;
+    while (i < n) tokens += token_detail::nextPiece(p, n, i);
+    return tokens;
+}
@@ -0,0 +1,482 @@
+#pragma once
+
+#include "crow_all.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// ===========================
+//  Upstream base URL
+// ===========================
+// Parsed form of e.g. "https://api.openai.com/v1" or "http://127.0.0.1:9000".
+struct UpstreamUrl {
+    bool tls = false;
+    std::string host;
+    std::string port;
+    std::string basePath;
+
+    static bool parse(const std::string& url, UpstreamUrl& out) {
+        UpstreamUrl u;
+        std::string rest;
+        if (url.compare(0, 8, "https://") == 0) {
+            u.tls = true;
+            rest = url.substr(8);
+        } else if (url.compare(0, 7, "http://") == 0) {
+            rest = url.substr(7);
+        } else {
+            return false;
+        }
+
+        size_t slash = rest.find('/');
+        std::string authority = rest.substr(0, slash);
+        u.basePath = slash == std::string::npos ? "" : rest.substr(slash);
+        while (!u.basePath.empty() && u.basePath.back() == '/') u.basePath.pop_back();
+
+        size_t colon = authority.rfind(':');
+        if (colon != std::string::npos) {
+            u.host = authority.substr(0, colon);
+            u.port = authority.substr(colon + 1);
+        } else {
+            u.host = authority;
+            u.port = u.tls ? "443" : "80";
+        }
+        if (u.host.empty() || u.port.empty()) return false;
+
+        out = std::move(u);
+        return true;
+    }
+
+    // Value for the Host header; the port is left out when it is the default.
+    std::string hostHeader() const {
+        bool defaultPort = (tls && port == "443") || (!tls && port == "80");
+        return defaultPort ? host : host + ":" + port;
+    }
+};
+
+// ===========================
+//  Upstream response
+// ===========================
+// status == 0 means the request never got an HTTP answer; see `error`.
+struct HttpResponse {
+    int status = 0;
+    std::string error;
+    std::unordered_map<std::string, std::string> headers; // lower-cased names
+    std::string body;
+
+    std::string header(const std::string& name) const {
+        auto it = headers.find(name);
+        return it == headers.end() ? std::string() : it->second;
+    }
+};
+
+namespace upstream_detail {
+
+using Clock = std::chrono::steady_clock;
+
+inline std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
+    return s;
+}
+
+inline std::string trim(const std::string& s) {
+    size_t b = s.find_first_not_of(" \t");
+    if (b == std::string::npos) return "";
+    size_t e = s.find_last_not_of(" \t\r");
+    return s.substr(b, e - b + 1);
+}
+
+// One keep-alive connection. Each connection owns its io_context, so the
+// calling thread drives its own I/O and can enforce a deadline with run_one_until.
+struct Connection {
+    crow::asio::io_context io;
+    std::unique_ptr<crow::tcp::socket> plain;
+#ifdef CROW_ENABLE_SSL
+    std::unique_ptr<crow::asio::ssl::stream<crow::tcp::socket>> tls;
+#endif
+    std::string buf;       // bytes read but not yet consumed
+    bool gotBytes = false; // whether the current request saw any response bytes
+    const std::atomic<bool>* cancel = nullptr; // set by the caller to abandon the exchange
+
+    crow::tcp::socket& lowest() {
+#ifdef CROW_ENABLE_SSL
+        if (tls) return tls->next_layer();
+#endif
+        return *plain;
+    }
+
+    template <typename Fn>
+    void withStream(Fn&& fn) {
+#ifdef CROW_ENABLE_SSL
+        if (tls) {
+            fn(*tls);
+            return;
+        }
+#endif
+        fn(*plain);
+    }
+
+    void close() {
+        crow::error_code ignored;
+        lowest().close(ignored);
+    }
+};
+
+// Runs the connection's io_context until `done` is set. If the deadline passes
+// (or the connection's cancel flag goes up) first, the socket is closed (plus
+// `abort`, if given), the aborted handler is drained and false is returned.
+template <typename Abort>
+bool runUntil(Connection& c, const bool& done, Clock::time_point deadline, Abort&& abort) {
+    c.io.restart();
+    while (!done) {
+        // With a cancel flag, wake up every few ms to look at it
+        Clock::time_point until = c.cancel ? std::min(deadline, Clock::now() + std::chrono::milliseconds(5)) : deadline;
+        bool cancelled = c.cancel && c.cancel->load(std::memory_order_relaxed);
+        if (cancelled || (c.io.run_one_until(until) == 0 && !done && (until == deadline || c.io.stopped()))) {
+            abort();
+            c.close();
+            c.io.restart();
+            c.io.run();
+            return false;
+        }
+    }
+    return true;
+}
+
+inline bool runUntil(Connection& c, const bool& done, Clock::time_point deadline) {
+    return runUntil(c, done, deadline, [] {});
+}
+
+inline crow::error_code timedOut() {
+    return crow::asio::error::make_error_code(crow::asio::error::timed_out);
+}
+
+template <typename Buffers>
+crow::error_code writeAll(Connection& c, const Buffers& data, Clock::time_point deadline) {
+    crow::error_code ec;
+    bool done = false;
+    c.withStream([&](auto& s) {
+        crow::asio::async_write(s, data, [&](crow::error_code e, size_t) {
+            ec = e;
+            done = true;
+        });
+    });
+    if (!runUntil(c, done, deadline)) return timedOut();
+    return ec;
+}
+
+inline crow::error_code readSome(Connection& c, Clock::time_point deadline) {
+    char chunk[16384];
+    size_t n = 0;
+    crow::error_code ec;
+    bool done = false;
+    c.withStream([&](auto& s) {
+        s.async_read_some(crow::asio::buffer(chunk), [&](crow::error_code e, size_t k) {
+            ec = e;
+            n = k;
+            done = true;
+        });
+    });
+    if (!runUntil(c, done, deadline)) return timedOut();
+    if (n > 0) {
+        c.buf.append(chunk, n);
+        c.gotBytes = true;
+    }
+    return ec;
+}
+
+// Reads one HTTP/1.1 response off the connection. `reusable` is set when the
+// response was fully framed and the server did not ask to close.
+inline crow::error_code readResponse(Connection& c, HttpResponse& res, bool& reusable, Clock::time_point deadline) {
+    reusable = false;
+    crow::error_code ec;
+
+    size_t headEnd;
+    while ((headEnd = c.buf.find("\r\n\r\n")) == std::string::npos) {
+        if ((ec = readSome(c, deadline))) return ec;
+    }
+
+    // Status line
+    size_t lineEnd = c.buf.find("\r\n");
+    std::string statusLine = c.buf.substr(0, lineEnd);
+    size_t sp = statusLine.find(' ');
+    if (statusLine.compare(0, 5, "HTTP/") != 0 || sp == std::string::npos) {
+        return crow::asio::error::make_error_code(crow::asio::error::invalid_argument);
+    }
+    bool http11 = statusLine.compare(0, 8, "HTTP/1.1") == 0;
+    res.status = std::atoi(statusLine.c_str() + sp + 1);
+
+    // Headers
+    size_t pos = lineEnd + 2;
+    while (pos < headEnd) {
+        size_t eol = c.buf.find("\r\n", pos);
+        std::string line = c.buf.substr(pos, eol - pos);
+        size_t colon = line.find(':');
+        if (colon != std::string::npos) {
+            res.headers[lower(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+        }
+        pos = eol + 2;
+    }
+    c.buf.erase(0, headEnd + 4);
+
+    bool keepAlive = http11 && lower(res.header("connection")) != "close";
+
+    // Body
+    if (lower(res.header("transfer-encoding")).find("chunked") != std::string::npos) {
+        for (;;) {
+            size_t eol;
+            while ((eol = c.buf.find("\r\n")) == std::string::npos) {
+                if ((ec = readSome(c, deadline))) return ec;
+            }
+            size_t size = std::strtoul(c.buf.c_str(), nullptr, 16);
+            c.buf.erase(0, eol + 2);
+            if (size == 0) {
+                // Skip optional trailers up to the terminating empty line
+                for (;;) {
+                    while ((eol = c.buf.find("\r\n")) == std::string::npos) {
+                        if ((ec = readSome(c, deadline))) return ec;
+                    }
+                    c.buf.erase(0, eol + 2);
+                    if (eol == 0) break;
+                }
+                break;
+            }
+            while (c.buf.size() < size + 2) {
+                if ((ec = readSome(c, deadline))) return ec;
+            }
+            res.body.append(c.buf, 0, size);
+            c.buf.erase(0, size + 2);
+        }
+    } else if (!res.header("content-length").empty()) {
+        size_t length = std::strtoul(res.header("content-length").c_str(), nullptr, 10);
+        while (c.buf.size() < length) {
+            if ((ec = readSome(c, deadline))) return ec;
+        }
+        res.body.assign(c.buf, 0, length);
+        c.buf.erase(0, length);
+    } else {
+        // No framing: the body runs until the server closes
+        for (;;) {
+            ec = readSome(c, deadline);
+            if (ec == crow::asio::error::eof) break;
+#ifdef CROW_ENABLE_SSL
+            if (ec == crow::asio::ssl::error::stream_truncated) break;
+#endif
+            if (ec) return ec;
+        }
+        res.body.swap(c.buf);
+        c.buf.clear();
+        keepAlive = false;
+    }
+
+    reusable = keepAlive;
+    return {};
+}
+
+} // namespace upstream_detail
+
+// ===========================
+//  Pooled HTTP/1.1 client
+// ===========================
+// Sends requests to one upstream base URL and keeps up to `maxIdle` idle
+// keep-alive connections around for reuse. Safe to call from many threads;
+// each call checks a connection out of the pool for its whole exchange.
+class UpstreamClient {
+public:
+    UpstreamClient(UpstreamUrl url, size_t maxIdle, std::chrono::milliseconds timeout):
+      url_(std::move(url)), maxIdle_(maxIdle), timeout_(timeout)
+#ifdef CROW_ENABLE_SSL
+      , sslContext_(crow::asio::ssl::context::tls_client)
+#endif
+    {
+#ifdef CROW_ENABLE_SSL
+        sslContext_.set_default_verify_paths();
+        sslContext_.set_verify_mode(crow::asio::ssl::verify_peer);
+#endif
+    }
+
+    UpstreamClient(const UpstreamClient&) = delete;
+    UpstreamClient& operator=(const UpstreamClient&) = delete;
+
+    const UpstreamUrl& url() const { return url_; }
+
+    // Number of TCP connections opened so far (reuse keeps this flat).
+    uint64_t connectionsOpened() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return opened_;
+    }
+
+    // Raising *cancel abandons the request within a few milliseconds; the
+    // connection is closed and the result has status 0, error "cancelled".
+    HttpResponse post(const std::string& path,
+                      const std::vector<std::pair<std::string, std::string>>& headers,
+                      const std::string& body,
+                      const std::atomic<bool>* cancel = nullptr) {
+        return request("POST", path, headers, body, cancel);
+    }
+
+    HttpResponse get(const std::string& path,
+                     const std::vector<std::pair<std::string, std::string>>& headers = {}) {
+        return request("GET", path, headers, std::string());
+    }
+
+    HttpResponse request(const char* method,
+                         const std::string& path,
+                         const std::vector<std::pair<std::string, std::string>>& headers,
+                         const std::string& body,
+                         const std::atomic<bool>* cancel = nullptr) {
+        // Only the head is formatted here; the body goes out as a second
+        // buffer of the same gathered write, straight from the caller's string.
+        std::string head = std::string(method) + " " + url_.basePath + path + " HTTP/1.1\r\n"
+                           "Host: " + url_.hostHeader() + "\r\n"
+                           "Connection: keep-alive\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n";
+        for (auto& h : headers) {
+            head += h.first + ": " + h.second + "\r\n";
+        }
+        head += "\r\n";
+        std::array<crow::asio::const_buffer, 2> request = {crow::asio::buffer(head), crow::asio::buffer(body)};
+
+        // A pooled connection may have been closed by the server while idle;
+        // in that case retry once on a fresh connection.
+        for (int attempt = 0;; attempt++) {
+            HttpResponse res;
+            auto deadline = upstream_detail::Clock::now() + timeout_;
+            bool reused = false;
+            std::unique_ptr<upstream_detail::Connection> conn = attempt == 0 ? acquire() : nullptr;
+            if (conn) {
+                reused = true;
+                conn->cancel = cancel;
+            } else {
+                conn = std::make_unique<upstream_detail::Connection>();
+                conn->cancel = cancel;
+                crow::error_code ec = open(*conn, deadline);
+                if (ec) {
+                    res.error = isCancelled(cancel) ? "cancelled"
+                                                    : "connect to " + url_.host + ":" + url_.port + " failed: " + ec.message();
+                    return res;
+                }
+            }
+
+            conn->gotBytes = false;
+            bool reusable = false;
+            crow::error_code ec = upstream_detail::writeAll(*conn, request, deadline);
+            if (!ec) ec = upstream_detail::readResponse(*conn, res, reusable, deadline);
+
+            if (ec) {
+                conn->close();
+                if (isCancelled(cancel)) {
+                    HttpResponse failed;
+                    failed.error = "cancelled";
+                    return failed;
+                }
+                if (reused && !conn->gotBytes && attempt == 0) continue;
+                HttpResponse failed;
+                failed.error = ec.message();
+                return failed;
+            }
+
+            conn->cancel = nullptr;
+            if (reusable) release(std::move(conn));
+            return res;
+        }
+    }
+
+private:
+    static bool isCancelled(const std::atomic<bool>* cancel) {
+        return cancel && cancel->load(std::memory_order_relaxed);
+    }
+
+    std::unique_ptr<upstream_detail::Connection> acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.empty()) return nullptr;
+        auto conn = std::move(idle_.back());
+        idle_.pop_back();
+        return conn;
+    }
+
+    void release(std::unique_ptr<upstream_detail::Connection> conn) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.size() < maxIdle_) idle_.push_back(std::move(conn));
+    }
+
+    crow::error_code open(upstream_detail::Connection& c, upstream_detail::Clock::time_point deadline) {
+        using namespace upstream_detail;
+        crow::error_code ec;
+
+#ifdef CROW_ENABLE_SSL
+        if (url_.tls) {
+            c.tls = std::make_unique<crow::asio::ssl::stream<crow::tcp::socket>>(c.io, sslContext_);
+        } else
+#endif
+        {
+            if (url_.tls) return crow::asio::error::make_error_code(crow::asio::error::operation_not_supported);
+            c.plain = std::make_unique<crow::tcp::socket>(c.io);
+        }
+
+        // Resolve and connect
+        crow::tcp::resolver resolver(c.io);
+        bool done = false;
+        bool expired = false;
+        resolver.async_resolve(url_.host, url_.port, [&](crow::error_code e, crow::tcp::resolver::results_type results) {
+            if (e || expired) {
+                ec = e;
+                done = true;
+                return;
+            }
+            crow::asio::async_connect(c.lowest(), results, [&](crow::error_code e2, const crow::tcp::endpoint&) {
+                ec = e2;
+                done = true;
+            });
+        });
+        if (!runUntil(c, done, deadline, [&] {
+                expired = true;
+                resolver.cancel();
+            })) {
+            return timedOut();
+        }
+        if (ec) return ec;
+
+        crow::error_code ignored;
+        c.lowest().set_option(crow::tcp::no_delay(true), ignored);
+
+#ifdef CROW_ENABLE_SSL
+        if (c.tls) {
+            SSL_set_tlsext_host_name(c.tls->native_handle(), url_.host.c_str());
+            c.tls->set_verify_callback(crow::asio::ssl::host_name_verification(url_.host));
+            done = false;
+            c.tls->async_handshake(crow::asio::ssl::stream_base::client, [&](crow::error_code e) {
+                ec = e;
+                done = true;
+            });
+            if (!runUntil(c, done, deadline)) return timedOut();
+            if (ec) return ec;
+        }
+#endif
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        opened_++;
+        return {};
+    }
+
+    UpstreamUrl url_;
+    size_t maxIdle_;
+    std::chrono::milliseconds timeout_;
+#ifdef CROW_ENABLE_SSL
+    crow::asio::ssl::context sslContext_;
+#endif
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<upstream_detail::Connection>> idle_;
+    uint64_t opened_ = 0;
+};